@@ -0,0 +1,117 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_ASYNC_SELF_ENCRYPTOR_H_
+#define MAIDSAFE_ENCRYPT_ASYNC_SELF_ENCRYPTOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/data_buffer.h"
+#include "maidsafe/common/types.h"
+
+#include "maidsafe/encrypt/data_map.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Starts fetching the named chunk and returns without waiting.  'on_fetched' must be called exactly
+// once, from any thread, with the chunk or with the exception which stopped the fetch.
+using AsyncGetFromStore = std::function<void(
+    const std::string& name, std::function<void(std::exception_ptr, NonEmptyString)> on_fetched)>;
+
+// Runs 'task' later, on any thread; e.g. posts it to an event loop or a thread pool.
+using Executor = std::function<void(std::function<void()> task)>;
+
+// A SelfEncryptor driven by completion handlers rather than blocking calls, so that a single
+// thread can serve many open files.  Calls are queued and run one at a time, in order, as tasks on
+// 'executor'.  Before each call runs, the remote chunks it may need are fetched without holding any
+// thread, so the call itself only does CPU work.  Should it need a chunk which wasn't fetched in
+// advance, it blocks its executor thread waiting for it; blocking_fetches() counts these.
+//
+// Handlers are called on an executor thread, with a null exception_ptr on success.  The encryptor
+// may be destroyed once the handler passed to Close has been called, including from within it, so
+// long as no other calls were queued after Close.
+class AsyncSelfEncryptor {
+ public:
+  using Handler = std::function<void(std::exception_ptr)>;
+  using ReadHandler = std::function<void(std::exception_ptr, std::string data)>;
+
+  AsyncSelfEncryptor(DataMap& data_map, DataBuffer& buffer, AsyncGetFromStore get_from_store,
+                     Executor executor);
+  AsyncSelfEncryptor(const AsyncSelfEncryptor&) = delete;
+  AsyncSelfEncryptor& operator=(const AsyncSelfEncryptor&) = delete;
+
+  // Reading past the end of the file fails with CommonErrors::invalid_argument.
+  void Read(uint64_t position, uint32_t length, ReadHandler handler);
+  void Write(std::string data, uint64_t position, Handler handler);
+  void Truncate(uint64_t position, Handler handler);
+  void Close(Handler handler);
+  uint64_t blocking_fetches() const { return blocking_fetches_; }
+
+ private:
+  struct Call {
+    Call() : plan(), run(), handler() {}
+    Call(std::function<std::vector<std::string>()> plan_in, std::function<void()> run_in,
+         Handler handler_in)
+        : plan(std::move(plan_in)), run(std::move(run_in)), handler(std::move(handler_in)) {}
+
+    std::function<std::vector<std::string>()> plan;  // names of the chunks to fetch first
+    std::function<void()> run;
+    Handler handler;
+  };
+
+  void Enqueue(Call call);
+  // Plans and starts the fetches for the call at the head of the queue.
+  void Start();
+  void Run();
+  // The SelfEncryptor's get_from_store functor, serving fetched_.
+  NonEmptyString GetFromStore(const std::string& name);
+  SelfEncryptor& self_encryptor();
+
+  DataMap& data_map_;
+  DataBuffer& buffer_;
+  AsyncGetFromStore get_from_store_;
+  Executor executor_;
+  // Constructed by the first call, as opening may itself fetch chunks.
+  std::unique_ptr<SelfEncryptor> self_encryptor_;
+  std::exception_ptr open_error_;
+  std::mutex mutex_;
+  std::deque<Call> calls_;
+  Call current_;
+  bool running_;
+  size_t fetches_pending_;
+  std::map<std::string, NonEmptyString> fetched_;
+  std::atomic<uint64_t> blocking_fetches_;
+};
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_ASYNC_SELF_ENCRYPTOR_H_
@@ -0,0 +1,59 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_BATCH_ENCRYPTOR_H_
+#define MAIDSAFE_ENCRYPT_BATCH_ENCRYPTOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "maidsafe/common/data_buffer.h"
+
+#include "maidsafe/encrypt/chunk_sink.h"
+#include "maidsafe/encrypt/data_map.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// The whole of one file's contents, held in memory by the caller.
+struct BatchFile {
+  BatchFile() : data(nullptr), size(0) {}
+  BatchFile(const char* data_in, uint64_t size_in) : data(data_in), size(size_in) {}
+
+  const char* data;
+  uint64_t size;
+};
+
+// Self-encrypts each of 'files', storing the chunks in 'buffer' and returning one data map per file
+// in the same order.  Each data map is the same as writing the file to a new SelfEncryptor and
+// closing it, but no encryptor, sequencer or copy of the file is created: files too small to be
+// chunked go straight into DataMap::content, and the chunks of all the others are encrypted
+// directly from the callers' memory by one shared set of worker tasks.  The first exception thrown
+// by encryption or 'buffer' is rethrown, in which case some chunks may already have been stored.
+std::vector<DataMap> EncryptFiles(const std::vector<BatchFile>& files, DataBuffer& buffer);
+
+// As above, passing the chunks to 'sink' in batches as described by 'sink_options'.
+std::vector<DataMap> EncryptFiles(const std::vector<BatchFile>& files, ChunkSink& sink,
+                                  const ChunkSinkOptions& sink_options = ChunkSinkOptions());
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_BATCH_ENCRYPTOR_H_
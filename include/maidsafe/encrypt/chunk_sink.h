@@ -0,0 +1,105 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_CHUNK_SINK_H_
+#define MAIDSAFE_ENCRYPT_CHUNK_SINK_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/data_buffer.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// An encrypted chunk on its way to storage, named by the SHA512 of its content.
+struct EncryptedChunk {
+  EncryptedChunk() : name(), content() {}
+  EncryptedChunk(std::string name_in, std::string content_in)
+      : name(std::move(name_in)), content(std::move(content_in)) {}
+
+  std::string name;
+  std::string content;
+};
+
+// Where encrypted chunks are stored.  Chunks are passed in batches, by move, from one worker
+// thread per encryptor at a time, though different encryptors sharing a sink may call Store
+// concurrently.  Store may block, which stalls encryption once enough batches are waiting (see
+// ChunkSinkOptions); an exception thrown by it fails the Close or EncryptFiles which made it.
+class ChunkSink {
+ public:
+  virtual ~ChunkSink() {}
+  virtual void Store(std::vector<EncryptedChunk> batch) = 0;
+};
+
+// How encrypted chunks are grouped on their way to a ChunkSink.  At most roughly
+// (max_pending_batches + 2) * batch_size encrypted chunks are held in memory waiting for it.
+struct ChunkSinkOptions {
+  ChunkSinkOptions() : batch_size(8), max_pending_batches(4) {}
+
+  uint32_t batch_size;           // chunks per call to ChunkSink::Store
+  uint32_t max_pending_batches;  // full batches waiting before encryption blocks
+};
+
+// Stores each chunk in 'buffer', as SelfEncryptor always used to.
+class DataBufferChunkSink : public ChunkSink {
+ public:
+  explicit DataBufferChunkSink(DataBuffer& buffer) : buffer_(buffer) {}
+  virtual void Store(std::vector<EncryptedChunk> batch) override;
+
+ private:
+  DataBuffer& buffer_;
+};
+
+// Writes each chunk to a file in 'directory' named by the hex encoding of the chunk's name.  The
+// directory is created if need be.  Chunks already present are left alone.
+class DirectoryChunkSink : public ChunkSink {
+ public:
+  explicit DirectoryChunkSink(boost::filesystem::path directory);
+  virtual void Store(std::vector<EncryptedChunk> batch) override;
+  // The file which holds, or would hold, the chunk with the given name.
+  boost::filesystem::path ChunkPath(const std::string& name) const;
+
+ private:
+  const boost::filesystem::path kDirectory_;
+};
+
+// Discards the chunks, only counting them, so that encryption can be measured without storage.
+class NullChunkSink : public ChunkSink {
+ public:
+  NullChunkSink() : batch_count_(0), chunk_count_(0), byte_count_(0) {}
+  virtual void Store(std::vector<EncryptedChunk> batch) override;
+  uint64_t batch_count() const { return batch_count_; }
+  uint64_t chunk_count() const { return chunk_count_; }
+  uint64_t byte_count() const { return byte_count_; }
+
+ private:
+  std::atomic<uint64_t> batch_count_, chunk_count_, byte_count_;
+};
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_CHUNK_SINK_H_
@@ -0,0 +1,76 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_CHUNK_TABLE_H_
+#define MAIDSAFE_ENCRYPT_CHUNK_TABLE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace maidsafe {
+
+namespace encrypt {
+
+enum class ChunkStatus : uint8_t {
+  absent,  // not yet loaded or written, or invalidated by a truncation
+  to_be_hashed,
+  to_be_encrypted,
+  stored,  // therefor only being used as read cache`
+  remote
+};
+
+// Status of each chunk of a file, held in a flat array indexed by chunk number.  Entries are
+// atomic, so Get, Set and Transition on entries within size() may be called concurrently; the
+// calls which can grow or shrink the table (Resize, Insert and Set beyond size()) must not race
+// with any other call.
+class ChunkTable {
+ public:
+  ChunkTable();
+  ChunkTable(const ChunkTable&) = delete;
+  ChunkTable(ChunkTable&&) = delete;
+  ChunkTable& operator=(ChunkTable) = delete;
+
+  // Entries added by growing are set to 'status'; shrinking drops entries from 'size' onwards.
+  void Resize(uint32_t size, ChunkStatus status = ChunkStatus::absent);
+  // ChunkStatus::absent for chunks beyond size().
+  ChunkStatus Get(uint32_t chunk) const {
+    return chunk < size_ ? statuses_[chunk].load(std::memory_order_acquire) : ChunkStatus::absent;
+  }
+  // Grows the table if needed.
+  void Set(uint32_t chunk, ChunkStatus status);
+  // Sets the status of an absent chunk, as std::map::insert would.  Returns false if it was
+  // already present.
+  bool Insert(uint32_t chunk, ChunkStatus status);
+  // Atomically replaces 'expected' with 'desired'.  Returns false, leaving the entry untouched, if
+  // it held some other status.
+  bool Transition(uint32_t chunk, ChunkStatus expected, ChunkStatus desired);
+  uint32_t size() const { return size_; }
+
+ private:
+  void Reserve(uint32_t capacity);
+
+  std::unique_ptr<std::atomic<ChunkStatus>[]> statuses_;
+  uint32_t size_, capacity_;
+};
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_CHUNK_TABLE_H_
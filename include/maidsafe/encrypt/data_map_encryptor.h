@@ -20,6 +20,7 @@
 #define MAIDSAFE_ENCRYPT_DATA_MAP_ENCRYPTOR_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "maidsafe/common/types.h"
 #include "maidsafe/common/crypto.h"
@@ -39,6 +40,19 @@ SerialisedData EncryptDataMap(const Identity& parent_id, const Identity& this_id
 DataMap DecryptDataMap(const Identity& parent_id, const Identity& this_id,
                        const SerialisedData& encrypted_data_map);
 
+// Batch forms of the above for many children of one parent, e.g. the entries of a directory.
+// Element i of the result corresponds to this_ids[i].  The work is split across Concurrency()
+// threads and key material derived from 'parent_id' is computed once for the whole batch.  Throws
+// CommonErrors::invalid_argument if the input vectors differ in size; otherwise the first
+// exception thrown for any element is rethrown.
+std::vector<SerialisedData> EncryptDataMaps(const Identity& parent_id,
+                                            const std::vector<Identity>& this_ids,
+                                            const std::vector<DataMap>& data_maps);
+
+std::vector<DataMap> DecryptDataMaps(const Identity& parent_id,
+                                     const std::vector<Identity>& this_ids,
+                                     const std::vector<SerialisedData>& encrypted_data_maps);
+
 }  // namespace encrypt
 
 }  // namespace maidsafe
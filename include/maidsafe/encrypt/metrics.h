@@ -0,0 +1,94 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_METRICS_H_
+#define MAIDSAFE_ENCRYPT_METRICS_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Stages of the self-encryption pipeline which are timed individually.
+enum class Phase : uint32_t {
+  kPreHash = 0,  // SHA512 of a chunk's plain text
+  kCompress,     // gzip
+  kEncrypt,      // AES-256-CFB
+  kXor,          // applying or removing the pad
+  kPostHash,     // SHA512 naming the encrypted chunk
+  kStore,        // storing a chunk via DataBufferChunkSink or DirectoryChunkSink
+  kFetch,        // get_from_store functor
+  kDecrypt,      // AES-256-CFB
+  kDecompress,   // gunzip
+  kCount
+};
+
+const size_t kPhaseCount(static_cast<size_t>(Phase::kCount));
+// Bucket i counts operations taking [2^i, 2^(i+1)) nanoseconds; the last bucket has no upper bound.
+const size_t kLatencyBucketCount(40);
+
+const char* PhaseName(Phase phase);
+
+struct PhaseMetrics {
+  PhaseMetrics() : count(0), bytes_in(0), bytes_out(0), total_nanoseconds(0), latency_histogram() {}
+
+  // Upper bound in nanoseconds of the given percentile (0.0 to 1.0) as read from the histogram.
+  uint64_t LatencyPercentile(double percentile) const;
+
+  uint64_t count, bytes_in, bytes_out, total_nanoseconds;
+  std::array<uint64_t, kLatencyBucketCount> latency_histogram;
+};
+
+struct MetricsSnapshot {
+  MetricsSnapshot()
+      : phases(),
+        chunks_encrypted(0),
+        chunks_reencrypted(0),
+        sequencer_bytes(0),
+        sequencer_high_water_mark(0) {}
+
+  const PhaseMetrics& operator[](Phase phase) const {
+    return phases[static_cast<size_t>(phase)];
+  }
+  // Compressed bytes per uncompressed byte, or 0 if nothing has been compressed.
+  double CompressionRatio() const;
+  // One line per phase followed by the chunk and sequencer counters.
+  std::string ToString() const;
+
+  std::array<PhaseMetrics, kPhaseCount> phases;
+  uint64_t chunks_encrypted;
+  uint64_t chunks_reencrypted;  // chunks which already had a stored version
+  uint64_t sequencer_bytes;     // currently allocated by all sequencers
+  uint64_t sequencer_high_water_mark;
+};
+
+// Process-wide totals.  Each thread updates its own counters without locking; they are summed
+// here, so a snapshot taken while encryptors are running may miss operations still in flight.
+MetricsSnapshot GetMetrics();
+
+// Restarts all counters from zero.  The sequencer high-water mark restarts from current usage.
+void ResetMetrics();
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_METRICS_H_
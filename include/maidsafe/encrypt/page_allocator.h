@@ -0,0 +1,88 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_PAGE_ALLOCATOR_H_
+#define MAIDSAFE_ENCRYPT_PAGE_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// How large buffers (the sequencer) are backed.  Huge pages are only used for allocations of at
+// least HugePageSize() bytes; anything smaller, or any platform without huge page support, falls
+// back to the standard allocator.
+enum class PagePolicy : uint32_t {
+  kStandard = 0,
+  kTransparentHuge,  // 2 MiB-aligned anonymous mapping advised for transparent huge pages
+  kExplicitHuge      // pre-faulted hugetlbfs mapping, falling back to kTransparentHuge
+};
+
+// Process-wide policy picked up by allocators constructed after the call.  Defaults to kStandard.
+void SetPagePolicy(PagePolicy policy);
+PagePolicy GetPagePolicy();
+
+size_t HugePageSize();
+
+namespace detail {
+
+void* AllocatePages(size_t size, PagePolicy policy);
+void DeallocatePages(void* ptr, size_t size, PagePolicy policy);
+
+}  // namespace detail
+
+template <typename T>
+class PageAllocator {
+ public:
+  typedef T value_type;
+
+  PageAllocator() : policy_(GetPagePolicy()) {}
+  explicit PageAllocator(PagePolicy policy) : policy_(policy) {}
+  template <typename U>
+  PageAllocator(const PageAllocator<U>& other)  // NOLINT (implicit rebind)
+      : policy_(other.policy()) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(detail::AllocatePages(count * sizeof(T), policy_));
+  }
+  void deallocate(T* ptr, size_t count) {
+    detail::DeallocatePages(ptr, count * sizeof(T), policy_);
+  }
+  PagePolicy policy() const { return policy_; }
+
+ private:
+  PagePolicy policy_;
+};
+
+template <typename T, typename U>
+bool operator==(const PageAllocator<T>& lhs, const PageAllocator<U>& rhs) {
+  return lhs.policy() == rhs.policy();
+}
+
+template <typename T, typename U>
+bool operator!=(const PageAllocator<T>& lhs, const PageAllocator<U>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_PAGE_ALLOCATOR_H_
@@ -0,0 +1,61 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_RESTORE_H_
+#define MAIDSAFE_ENCRYPT_RESTORE_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "maidsafe/common/types.h"
+
+#include "maidsafe/encrypt/data_map.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Sizes of the restore pipeline's stages.  Each queue holds whole chunks.  A chunk isn't fetched
+// until the chunk (fetch_threads + fetched_queue_depth + decrypt_threads + decrypted_queue_depth)
+// places before it has been passed to the sink, so at most that many chunks are held at once,
+// counting those being fetched, queued, decrypted or waiting to be passed to the sink in order.
+struct RestoreOptions {
+  RestoreOptions();
+
+  uint32_t fetch_threads;          // concurrent get_from_store calls
+  uint32_t fetched_queue_depth;    // encrypted chunks waiting to be decrypted
+  uint32_t decrypt_threads;        // defaults to Concurrency()
+  uint32_t decrypted_queue_depth;  // plain chunks waiting for the sink
+};
+
+// Writes the whole of the file described by 'data_map' to 'sink', in order and on the calling
+// thread.  Chunks are fetched and decrypted by separate stages connected by bounded queues, so
+// fetch latency overlaps decryption, and a slow sink stalls the stages rather than letting data
+// pile up.  Chunks of '\0's written as such are not fetched.  The first exception thrown by
+// 'get_from_store', decryption or 'sink' stops the pipeline and is rethrown.
+void Restore(const DataMap& data_map,
+             std::function<NonEmptyString(const std::string&)> get_from_store,
+             std::function<void(const char* data, uint32_t length, uint64_t position)> sink,
+             const RestoreOptions& options = RestoreOptions());
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_RESTORE_H_
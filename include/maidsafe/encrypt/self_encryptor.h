@@ -21,32 +21,52 @@
 
 #include <cstdint>
 #include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <array>
 #include <vector>
 #include <deque>
 #include <map>
 #include <utility>
+
+#include "boost/thread/shared_mutex.hpp"
+
 #include "maidsafe/common/crypto.h"
 #include "maidsafe/common/types.h"
 #include "maidsafe/common/data_buffer.h"
 
+#include "maidsafe/encrypt/chunk_sink.h"
+#include "maidsafe/encrypt/chunk_table.h"
 #include "maidsafe/encrypt/data_map.h"
+#include "maidsafe/encrypt/sequencer.h"
 
 namespace maidsafe {
 
 namespace encrypt {
+class AsyncSelfEncryptor;
 class Cache;
+struct ChunkKeys;
+class ChunkSinkQueue;
 namespace test {
 class PrivateSelfEncryptorTest;
+class SelfEncryptorKernels;
 }
 
+// Read may be called from any number of threads at once, including while CloseAsync finishes in
+// the background.  Concurrent reads of different chunks fetch and decrypt them in parallel, while
+// those needing the same chunk wait for a single decryption of it.  Write, Truncate and Close each
+// wait for the reads in progress and hold off new ones until they return.
 class SelfEncryptor {
  public:
   SelfEncryptor(DataMap& data_map, DataBuffer& buffer,
                 std::function<NonEmptyString(const std::string&)> get_from_store);
+  // Passes the chunks encrypted by Close to 'sink', which must outlive the encryptor.
+  SelfEncryptor(DataMap& data_map, ChunkSink& sink,
+                std::function<NonEmptyString(const std::string&)> get_from_store,
+                const ChunkSinkOptions& sink_options = ChunkSinkOptions());
   ~SelfEncryptor();
   SelfEncryptor(const SelfEncryptor&) = delete;
   SelfEncryptor(SelfEncryptor&&) = delete;
@@ -56,28 +76,104 @@ class SelfEncryptor {
   bool Read(char* data, uint32_t length, uint64_t position);
   // Can truncate up or down
   bool Truncate(uint64_t position);
-  // Forces all buffered data to be encrypted.  Missing portions of the file are filled with '\0's
+  // Forces all buffered data to be encrypted.  Missing portions of the file are filled with '\0's.
+  // If nothing has been written or truncated since opening, the data map is left as it was and no
+  // chunks are encrypted or stored.
   void Close();
+  // As Close, but only the cheap bookkeeping is done before returning; hashing, encrypting and
+  // storing the chunks is left to a worker thread, and the returned future holds the final data
+  // map, or the exception which stopped it.  Until the encryptor is destroyed it can still be read
+  // from, whether or not the future is ready, though anything else throws encryptor_closed.
+  // Calling Close, or destroying the encryptor, waits for the worker to finish.
+  std::future<DataMap> CloseAsync();
   bool Flush();
   uint64_t size() const { return file_size_; }
   const DataMap& data_map() const { return data_map_; }
-  const DataMap& original_data_map() const { return kOriginalDataMap_; }
 
+  friend class AsyncSelfEncryptor;
   friend class test::PrivateSelfEncryptorTest;
+  friend class test::SelfEncryptorKernels;
 
  private:
-  // read in all data and up to next 2 chunks
-  void PrepareWindow(uint32_t length, uint64_t position, bool write);
-  // Retrieves the encrypted chunk from chunk_store_ and decrypts it to "data".
+  SelfEncryptor(DataMap& data_map, std::unique_ptr<ChunkSink> owned_sink, ChunkSink* sink,
+                std::function<NonEmptyString(const std::string&)> get_from_store,
+                const ChunkSinkOptions& sink_options);
+  // Loads the chunks a write to the range changes, and the next two, marking them to be hashed.
+  void PrepareWindow(uint32_t length, uint64_t position);
+  // True if a pending truncation, leaving small file mode, or growing sequencer_ must be done
+  // under the exclusive lock before reading.
+  bool ReadNeedsPreparing() const;
+  // The body of Read, called with file_mutex_ shared.
+  void ReadShared(char* data, uint32_t length, uint64_t position);
+  // Loads the remote chunks covering the range, and if 'read_ahead' the next two, into sequencer_
+  // as stored.  Safe to call concurrently.
+  void LoadWindow(uint32_t length, uint64_t position, bool read_ahead);
+  // Decrypts the chunk into sequencer_ and sets its status to 'loaded_status', unless another
+  // thread has already loaded it.
+  void LoadChunk(uint32_t chunk_num, ChunkStatus loaded_status);
+  void ReadSequencer(char* data, uint32_t length, uint64_t position) const;
+  // Discards data and chunk state beyond the lowest size truncated to since the last call.
+  void ApplyTruncate();
+  // The first part of Close, done on the caller's thread by CloseAsync.  Returns true if nothing
+  // is left for FinishClose to do.
+  bool BeginClose();
+  // Hashes, encrypts and stores the chunks marked by BeginClose.
+  void FinishClose();
+  // Serves reads once CloseAsync has been called, without changing sequencer_ or chunks_.
+  void ReadAfterClose(char* data, uint32_t length, uint64_t position);
+  // Names of the remote chunks which the next Read (or Write if 'write') of the range, or the next
+  // Close, may fetch.  A superset, so that they can all be fetched before making the call.
+  std::vector<std::string> GetChunksToFetch(uint64_t position, uint32_t length, bool write) const;
+  std::vector<std::string> GetChunksToFetchOnClose() const;
+  // Adds to 'chunks' those remote chunks which a pending truncation will load, returning the first
+  // chunk whose entry it will drop, or max() if none is pending.
+  uint32_t AddChunksLoadedByTruncate(std::set<uint32_t>& chunks) const;
+  // Names of those of 'chunks' which are remote and not runs of '\0's.
+  std::vector<std::string> GetRemoteChunkNames(const std::set<uint32_t>& chunks) const;
+  // Drops the chunk entries whose layout changed when the file grew from 'old_size'.
+  void ApplyGrowth(uint64_t old_size);
+  // Drops the entries of chunks from 'first_invalid' on, first loading any still remote which
+  // start before 'size' into sequencer_.
+  void InvalidateChunksFrom(uint32_t first_invalid, uint64_t size);
+  // Moves the contents of small_file_content_ into sequencer_ once the file has grown too big to
+  // be held in data_map_.content.
+  void LeaveSmallFileMode();
+  // Marks for re-encryption the chunks whose key material depends on a chunk being rehashed.
+  void ReencryptSuccessors();
+  // Decrypts straight into the caller's buffer those remote chunks which lie wholly within the
+  // range, in parallel and bypassing sequencer_.  The rest of the range is read via the window.
+  void ScatterRead(char* data, uint32_t length, uint64_t position);
+  // Remote chunks lying wholly within the range whose stored layout matches the current one.
+  std::vector<uint32_t> GetScatterReadChunks(uint32_t length, uint64_t position) const;
+  // Retrieves the encrypted chunk from chunk_store_ and decrypts it to "data".  Doesn't touch
+  // chunks_, so may be called from worker threads; the caller updates the chunk's status.
   ByteVector DecryptChunk(uint32_t chunk_num);
+  // As above, writing the chunk's data_map_ size bytes to 'data'.
+  void DecryptChunk(uint32_t chunk_num, byte* data);
   // Retrieves appropriate pre-hashes from data_map_ and constructs key, IV and
-  // encryption pad.
-  void GetPadIvKey(uint32_t this_chunk_num, ByteVector& key, ByteVector& iv, ByteVector& pad);
-  // Encrypts the chunk and stores in chunk_store_
-  void EncryptChunk(uint32_t chunk_num, ByteVector data, uint32_t length);
+  // encryption pad.  These are cached per chunk, so are only derived again once
+  // InvalidatePadIvKey has been called for a chunk whose pre-hash they depend on.
+  std::shared_ptr<const ChunkKeys> GetPadIvKey(uint32_t this_chunk_num);
+  // Drops the cached key material of the chunk and of the two after it, whose keys and pads also
+  // depend on its pre-hash.  Threads still holding the old keys keep them alive until they're done.
+  void InvalidatePadIvKey(uint32_t this_chunk_num);
+  void ResetPadIvKeys();
+  // Encrypts the chunk and passes it to 'sink_queue'.
+  void EncryptChunk(uint32_t chunk_num, const ByteVector& data, uint32_t length,
+                    ChunkSinkQueue& sink_queue);
+  // True if the chunk and its two predecessors all have the pre-hash of a chunk of '\0's.
+  bool HasZeroPreHashes(uint32_t chunk_num) const;
+  // True if the stored chunk is a run of '\0's, so it can be read without fetching it.
+  bool IsStoredZeroChunk(uint32_t chunk_num) const;
+  // Save the entries of data_map_ in [begin, end), or its content, as they were when opened, if not
+  // already saved.  Must be called on the thread running Close before the entries are changed.
+  void JournalChunks(uint32_t begin, uint32_t end);
+  void JournalContent();
+  // Restores data_map_ to how it was when opened from the entries journalled since.
+  void RollBack();
   void CleanUpAfterException() {
-    std::swap(data_map_, kOriginalDataMap_);
-    assert(false && "cleaned up after exception");
+    RollBack();
+    ResetPadIvKeys();
   }
   // ###############################################################################
   // these are some handy helper methods to translate position and lengths into chunk
@@ -88,22 +184,63 @@ class SelfEncryptor {
   uint32_t GetNextChunkNumber(uint32_t chunk_number) const;      // not ++chunk_number
   uint32_t GetPreviousChunkNumber(uint32_t chunk_number) const;  // not --chunk_number
   uint32_t GetChunkNumber(uint64_t position) const;
+  // Start position of a chunk as laid out in the stored (not the current) data map.
+  uint64_t GetStoredStartPosition(uint32_t chunk_number) const;
   // ########end of helpers#########################################################
 
-  enum class ChunkStatus {
-    to_be_hashed,
-    to_be_encrypted,
-    stored,  // therefor only being used as read cache`
-    remote
+  // The parts of data_map_ changed by Close, as they were on opening.  Entries are only saved just
+  // before they change, so opening a file costs the same whatever its size.
+  struct UndoJournal {
+    explicit UndoJournal(const DataMap& data_map)
+        : chunk_count(static_cast<uint32_t>(data_map.chunks.size())),
+          chunks(),
+          content_saved(false),
+          content() {}
+
+    const uint32_t chunk_count;
+    std::map<uint32_t, ChunkDetails> chunks;
+    bool content_saved;
+    ByteVector content;
   };
 
-  DataMap& data_map_, kOriginalDataMap_;
-  std::vector<byte> sequencer_;
-  std::map<uint32_t, ChunkStatus> chunks_;
-  DataBuffer& buffer_;
+  DataMap& data_map_;
+  UndoJournal undo_journal_;
+  Sequencer sequencer_;
+  // While a file opened with no chunks stays below 3 * kMinChunkSize, it's held here rather than
+  // in sequencer_, which would allocate a whole segment for it.  Bytes between its size and
+  // file_size_ are '\0's.
+  bool small_file_mode_;
+  ByteVector small_file_content_;
+  ChunkTable chunks_;
+  // Indexed by chunk number in data_map_; null until the chunk's key material is first needed.
+  std::vector<std::shared_ptr<const ChunkKeys>> chunk_keys_;
+  // Set if constructed with a DataBuffer, which is wrapped in a DataBufferChunkSink.
+  std::unique_ptr<ChunkSink> owned_sink_;
+  ChunkSink& sink_;
+  const ChunkSinkOptions kSinkOptions_;
   std::function<NonEmptyString(const std::string&)> get_from_store_;
   uint64_t file_size_;
+  // Lowest size truncated to and not yet applied, or max() if none is pending.
+  uint64_t truncated_size_;
+  // Set by Write and Truncate; until then Close has nothing to do.
+  bool modified_;
   bool closed_;
+  // Set by CloseAsync, which leaves the encryptor readable.
+  bool readable_after_close_;
+  std::future<void> finalisation_;
+  // Shared by Read, and held exclusively by the calls which change the file.
+  boost::shared_mutex file_mutex_;
+  // Held exclusively while a reader loads a chunk into sequencer_, and shared while reading it.
+  mutable boost::shared_mutex sequencer_mutex_;
+  // Chunk n is only loaded while holding chunk_mutexes_[n % size], so it's decrypted once even
+  // when several readers need it, while readers of other chunks mostly go on unhindered.
+  std::array<std::mutex, 16> chunk_mutexes_;
+  // Shared by ReadAfterClose, which reads data_map_'s entries unlocked, and held exclusively while
+  // a failed CloseAsync rolls them back.  Not file_mutex_, which Close holds while waiting for it.
+  boost::shared_mutex rollback_mutex_;
+  // Held by the rollback while it waits for rollback_mutex_, and by readers while they take their
+  // share of it, as boost::shared_mutex lets a steady stream of readers starve a waiting writer.
+  std::mutex rollback_gate_;
   mutable std::mutex data_mutex_;
 };
 
@@ -0,0 +1,66 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_SEQUENCER_H_
+#define MAIDSAFE_ENCRYPT_SEQUENCER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "maidsafe/common/types.h"
+
+#include "maidsafe/encrypt/page_allocator.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Plain-text view of a file, held as a list of fixed-size segments.  Segments are only allocated
+// when non-zero data is first written to them, so unwritten ranges (holes) cost no memory and read
+// back as '\0's.  Existing segments are never reallocated or copied.  Concurrent Read and IsHole
+// calls are safe; Write and Resize must not race with any other call.
+class Sequencer {
+ public:
+  Sequencer();
+  ~Sequencer();
+  Sequencer(const Sequencer&) = delete;
+  Sequencer(Sequencer&&) = delete;
+  Sequencer& operator=(Sequencer) = delete;
+
+  // Bytes beyond the old size are zero after growing; shrinking releases whole segments.
+  void Resize(uint64_t size);
+  void Write(const byte* data, uint32_t length, uint64_t position);
+  void Read(byte* data, uint32_t length, uint64_t position) const;
+  // True if no segment overlapping the range has been allocated, i.e. the range is all '\0's.
+  bool IsHole(uint64_t position, uint64_t length) const;
+  uint64_t size() const { return size_; }
+  uint32_t segment_size() const { return kSegmentSize_; }
+
+ private:
+  typedef std::vector<byte, PageAllocator<byte>> Segment;  // empty if not yet allocated
+
+  const uint32_t kSegmentSize_;
+  std::vector<Segment> segments_;
+  uint64_t size_;
+};
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_SEQUENCER_H_
@@ -0,0 +1,132 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_TRACE_H_
+#define MAIDSAFE_ENCRYPT_TRACE_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/data_buffer.h"
+#include "maidsafe/common/types.h"
+
+#include "maidsafe/encrypt/data_map.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// A trace records the shape, but not the data, of the calls made to a SelfEncryptor.  It is text,
+// one call per line:
+//   W <position> <length>  Write
+//   R <position> <length>  Read
+//   T <position>           Truncate
+//   F                      Flush
+//   C                      Close, with the following calls made on a new encryptor over the
+//                          resulting data map
+// Blank lines and lines starting with '#' are ignored.
+struct TraceOperation {
+  enum class Type : char {
+    kWrite = 'W',
+    kRead = 'R',
+    kTruncate = 'T',
+    kFlush = 'F',
+    kClose = 'C'
+  };
+
+  TraceOperation() : type(Type::kFlush), position(0), length(0) {}
+  TraceOperation(Type type_in, uint64_t position_in = 0, uint32_t length_in = 0)
+      : type(type_in), position(position_in), length(length_in) {}
+
+  Type type;
+  uint64_t position;
+  uint32_t length;  // only used by kWrite and kRead
+};
+
+bool operator==(const TraceOperation& lhs, const TraceOperation& rhs);
+bool operator!=(const TraceOperation& lhs, const TraceOperation& rhs);
+
+// Throws CommonErrors::parsing_error, giving the line number, if any line is malformed.
+std::vector<TraceOperation> ReadTrace(std::istream& input);
+void WriteTrace(std::ostream& output, const TraceOperation& operation);
+
+// Forwards every call to a SelfEncryptor, appending it to 'trace'.  Closing it ends the trace's
+// current session; to record a reopened file, construct a new one over the same stream.
+class TracingSelfEncryptor {
+ public:
+  TracingSelfEncryptor(DataMap& data_map, DataBuffer& buffer,
+                       std::function<NonEmptyString(const std::string&)> get_from_store,
+                       std::ostream& trace);
+  TracingSelfEncryptor(const TracingSelfEncryptor&) = delete;
+  TracingSelfEncryptor& operator=(const TracingSelfEncryptor&) = delete;
+
+  bool Write(const char* data, uint32_t length, uint64_t position);
+  bool Read(char* data, uint32_t length, uint64_t position);
+  bool Truncate(uint64_t position);
+  void Close();
+  bool Flush();
+  uint64_t size() const { return self_encryptor_.size(); }
+  const DataMap& data_map() const { return self_encryptor_.data_map(); }
+
+ private:
+  SelfEncryptor self_encryptor_;
+  std::ostream& trace_;
+};
+
+struct OperationLatencies {
+  OperationLatencies() : count(0), total(0), p50(0), p99(0), max(0) {}
+
+  uint64_t count;
+  std::chrono::nanoseconds total, p50, p99, max;
+};
+
+struct ReplayResult {
+  ReplayResult()
+      : latencies(), bytes_written(0), bytes_read(0), failed_reads(0), wall_time(0), cpu_time(0) {}
+
+  const OperationLatencies& operator[](TraceOperation::Type type) const;
+  // One line per operation type followed by the totals.
+  std::string ToString() const;
+
+  // Indexed in the order write, read, truncate, flush, close.
+  std::array<OperationLatencies, 5> latencies;
+  uint64_t bytes_written, bytes_read;
+  // Reads which returned false or, if verifying, didn't match the data written.
+  uint64_t failed_reads;
+  std::chrono::nanoseconds wall_time;
+  // Processor time of the whole process, so includes the encryptors' worker threads.
+  std::chrono::nanoseconds cpu_time;
+};
+
+// Runs 'trace' against a new file, writing random data.  If 'verify' is true, a copy of the file
+// is kept in memory and every read is checked against it.
+ReplayResult ReplayTrace(const std::vector<TraceOperation>& trace, DataBuffer& buffer,
+                         std::function<NonEmptyString(const std::string&)> get_from_store,
+                         bool verify);
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_TRACE_H_
@@ -0,0 +1,219 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/async_self_encryptor.h"
+
+#include <future>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+
+#include "maidsafe/encrypt/chunk_crypto.h"
+#include "maidsafe/encrypt/config.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+AsyncSelfEncryptor::AsyncSelfEncryptor(DataMap& data_map, DataBuffer& buffer,
+                                       AsyncGetFromStore get_from_store, Executor executor)
+    : data_map_(data_map),
+      buffer_(buffer),
+      get_from_store_(std::move(get_from_store)),
+      executor_(std::move(executor)),
+      self_encryptor_(),
+      open_error_(),
+      mutex_(),
+      calls_(),
+      current_(),
+      running_(false),
+      fetches_pending_(0),
+      fetched_(),
+      blocking_fetches_(0) {
+  if (!get_from_store_ || !executor_) {
+    LOG(kError) << "Need to have non-null get_from_store and executor functors.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  // opening a file split into three equal chunks loads all of them
+  Enqueue(Call(
+      [this] {
+        std::vector<std::string> names;
+        if (data_map_.chunks.empty() || data_map_.size() >= 3 * kMaxChunkSize)
+          return names;
+        for (const auto& chunk : data_map_.chunks) {
+          if (chunk.pre_hash != ZeroPreHash() || chunk.hash != GetZeroChunk(chunk.size)->hash)
+            names.emplace_back(std::begin(chunk.hash), std::end(chunk.hash));
+        }
+        return names;
+      },
+      [this] {
+        self_encryptor_.reset(new SelfEncryptor(
+            data_map_, buffer_, [this](const std::string& name) { return GetFromStore(name); }));
+      },
+      [this](std::exception_ptr error) { open_error_ = error; }));
+}
+
+void AsyncSelfEncryptor::Read(uint64_t position, uint32_t length, ReadHandler handler) {
+  auto data(std::make_shared<std::string>());
+  Enqueue(Call(
+      [=] { return self_encryptor().GetChunksToFetch(position, length, false); },
+      [=] {
+        data->resize(length);
+        if (!self_encryptor().Read(&(*data)[0], length, position))
+          BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+      },
+      [=](std::exception_ptr error) {
+        handler(error, error ? std::string() : std::move(*data));
+      }));
+}
+
+void AsyncSelfEncryptor::Write(std::string data, uint64_t position, Handler handler) {
+  auto shared_data(std::make_shared<std::string>(std::move(data)));
+  Enqueue(Call(
+      [=] {
+        return self_encryptor().GetChunksToFetch(
+            position, static_cast<uint32_t>(shared_data->size()), true);
+      },
+      [=] {
+        self_encryptor().Write(shared_data->data(), static_cast<uint32_t>(shared_data->size()),
+                               position);
+      },
+      std::move(handler)));
+}
+
+void AsyncSelfEncryptor::Truncate(uint64_t position, Handler handler) {
+  // the chunks a truncation loads are fetched before the next call instead
+  Enqueue(Call([] { return std::vector<std::string>(); },
+               [=] { self_encryptor().Truncate(position); }, std::move(handler)));
+}
+
+void AsyncSelfEncryptor::Close(Handler handler) {
+  Enqueue(Call(
+      [this] {
+        return self_encryptor_ ? self_encryptor_->GetChunksToFetchOnClose()
+                               : std::vector<std::string>();
+      },
+      [this] {
+        if (self_encryptor_)
+          self_encryptor_->Close();
+        if (open_error_)
+          std::rethrow_exception(open_error_);
+      },
+      std::move(handler)));
+}
+
+void AsyncSelfEncryptor::Enqueue(Call call) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  calls_.push_back(std::move(call));
+  if (!running_) {
+    running_ = true;
+    executor_([this] { Start(); });
+  }
+}
+
+void AsyncSelfEncryptor::Start() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_ = std::move(calls_.front());
+    calls_.pop_front();
+  }
+  std::vector<std::string> names;
+  try {
+    names = current_.plan();
+  } catch (...) {
+    // the call itself fails in the same way
+  }
+  if (names.empty()) {
+    Run();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fetches_pending_ = names.size();
+  }
+  for (const auto& name : names) {
+    // A failed fetch isn't fatal to the call, which may not need the chunk after all; if it does,
+    // it fetches it again itself and fails then.
+    get_from_store_(name, [this, name](std::exception_ptr error, NonEmptyString content) {
+      bool all_fetched(false);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error)
+          fetched_.emplace(name, std::move(content));
+        all_fetched = (--fetches_pending_ == 0);
+      }
+      if (all_fetched)
+        executor_([this] { Run(); });
+    });
+  }
+}
+
+void AsyncSelfEncryptor::Run() {
+  std::exception_ptr error;
+  try {
+    current_.run();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  Handler handler(std::move(current_.handler));
+  current_ = Call();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fetched_.clear();
+    if (calls_.empty())
+      running_ = false;
+    else
+      executor_([this] { Start(); });
+  }
+  // last, as the handler of Close may destroy this
+  if (handler)
+    handler(error);
+}
+
+NonEmptyString AsyncSelfEncryptor::GetFromStore(const std::string& name) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto itr(fetched_.find(name));
+    // Kept until Run clears fetched_, as a call may decrypt a stored chunk more than once, e.g.
+    // when chunks of repeated content share its name.
+    if (itr != std::end(fetched_))
+      return itr->second;
+  }
+  ++blocking_fetches_;
+  auto promise(std::make_shared<std::promise<NonEmptyString>>());
+  auto future(promise->get_future());
+  get_from_store_(name, [promise](std::exception_ptr error, NonEmptyString content) {
+    if (error)
+      promise->set_exception(error);
+    else
+      promise->set_value(std::move(content));
+  });
+  return future.get();
+}
+
+SelfEncryptor& AsyncSelfEncryptor::self_encryptor() {
+  if (open_error_)
+    std::rethrow_exception(open_error_);
+  return *self_encryptor_;
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,109 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/batch_encryptor.h"
+
+#include <string>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+
+#include "maidsafe/encrypt/chunk_crypto.h"
+#include "maidsafe/encrypt/chunk_layout.h"
+#include "maidsafe/encrypt/chunk_sink_queue.h"
+#include "maidsafe/encrypt/metrics_recorder.h"
+#include "maidsafe/encrypt/parallel.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+struct ChunkPosition {
+  ChunkPosition(uint32_t file_in, uint32_t chunk_in, uint64_t offset_in)
+      : file(file_in), chunk(chunk_in), offset(offset_in) {}
+
+  uint32_t file, chunk;
+  uint64_t offset;  // of the chunk's first byte within the file
+};
+
+const byte* Bytes(const BatchFile& file, uint64_t offset) {
+  return reinterpret_cast<const byte*>(file.data) + offset;
+}
+
+}  // unnamed namespace
+
+std::vector<DataMap> EncryptFiles(const std::vector<BatchFile>& files, DataBuffer& buffer) {
+  DataBufferChunkSink sink(buffer);
+  return EncryptFiles(files, sink);
+}
+
+std::vector<DataMap> EncryptFiles(const std::vector<BatchFile>& files, ChunkSink& sink,
+                                  const ChunkSinkOptions& sink_options) {
+  std::vector<DataMap> data_maps(files.size());
+  std::vector<ChunkPosition> positions;
+  for (uint32_t file(0); file < files.size(); ++file) {
+    if (files[file].size != 0 && files[file].data == nullptr)
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::null_pointer));
+    auto chunk_count(NumChunks(files[file].size));
+    if (chunk_count == 0) {
+      data_maps[file].content.assign(Bytes(files[file], 0), Bytes(files[file], files[file].size));
+      continue;
+    }
+    // Pre-hashing only reads a chunk's first few bytes, so isn't worth farming out.
+    data_maps[file].chunks.resize(chunk_count);
+    uint64_t offset(0);
+    for (uint32_t chunk(0); chunk < chunk_count; ++chunk) {
+      auto& details(data_maps[file].chunks[chunk]);
+      details.size = ChunkSize(files[file].size, chunk);
+      CalculatePreHash(Bytes(files[file], offset), details.pre_hash);
+      positions.emplace_back(file, chunk, offset);
+      offset += details.size;
+    }
+  }
+
+  ChunkSinkQueue sink_queue(sink, sink_options);
+  // Each task only writes to the ChunkDetails of its own chunks, so no locking is needed.
+  ForEachRangeInParallel(positions.size(), [&](size_t begin, size_t end) {
+    ChunkKeys keys;
+    for (auto i(begin); i < end; ++i) {
+      const auto& position(positions[i]);
+      auto& chunks(data_maps[position.file].chunks);
+      auto chunk_count(static_cast<uint32_t>(chunks.size()));
+      uint32_t n_1_chunk((chunk_count + position.chunk - 1) % chunk_count);
+      uint32_t n_2_chunk((chunk_count + position.chunk - 2) % chunk_count);
+      auto& details(chunks[position.chunk]);
+      DerivePadIvKey(details.pre_hash, chunks[n_1_chunk].pre_hash, chunks[n_2_chunk].pre_hash,
+                     keys);
+      std::string encrypted;
+      std::string hash(EncryptContent(Bytes(files[position.file], position.offset), details.size,
+                                      keys, encrypted));
+      details.hash.assign(std::begin(hash), std::end(hash));
+      sink_queue.Add(EncryptedChunk(std::move(hash), std::move(encrypted)));
+      RecordChunkEncrypted(false);
+      details.storage_state = ChunkDetails::kPending;
+    }
+  });
+  sink_queue.Flush();
+  return data_maps;
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
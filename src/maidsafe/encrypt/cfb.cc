@@ -0,0 +1,214 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/cfb.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MAIDSAFE_ENCRYPT_AESNI
+#ifdef __MSVC__
+#include <intrin.h>
+#endif
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#ifdef __MSVC__
+#pragma warning(push, 1)
+#endif
+#include "cryptopp/aes.h"
+#include "cryptopp/modes.h"
+#ifdef __MSVC__
+#pragma warning(pop)
+#endif
+
+#include "maidsafe/common/crypto.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+#ifdef MAIDSAFE_ENCRYPT_AESNI
+
+// The kernels are compiled for AES-NI regardless of the target architecture flags and only called
+// once the processor has been checked for it.
+#ifdef __MSVC__
+#define MAIDSAFE_AESNI_TARGET
+#else
+#define MAIDSAFE_AESNI_TARGET __attribute__((target("aes,sse2")))
+#endif
+
+const int kRounds(14);
+const size_t kBlockSize(16);
+const size_t kInterleave(8);
+
+bool DetectAesNi() {
+#ifdef __MSVC__
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 25)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("aes") != 0;
+#endif
+}
+
+MAIDSAFE_AESNI_TARGET inline __m128i Load(const byte* data) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+MAIDSAFE_AESNI_TARGET inline void Store(__m128i block, byte* data) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(data), block);
+}
+
+MAIDSAFE_AESNI_TARGET inline __m128i ShiftXor(__m128i key) {
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, _mm_slli_si128(key, 4));
+}
+
+// _mm_aeskeygenassist_si128 needs its round constant as an immediate, hence the macros.
+#define MAIDSAFE_EXPAND_EVEN_ROUND_KEY(i, rcon)                          \
+  round_keys[i] = _mm_xor_si128(                                         \
+      ShiftXor(round_keys[i - 2]),                                       \
+      _mm_shuffle_epi32(_mm_aeskeygenassist_si128(round_keys[i - 1], rcon), 0xff))
+#define MAIDSAFE_EXPAND_ODD_ROUND_KEY(i)                                 \
+  round_keys[i] = _mm_xor_si128(                                         \
+      ShiftXor(round_keys[i - 2]),                                       \
+      _mm_shuffle_epi32(_mm_aeskeygenassist_si128(round_keys[i - 1], 0), 0xaa))
+
+MAIDSAFE_AESNI_TARGET void ExpandKey(const byte* key, __m128i* round_keys) {
+  round_keys[0] = Load(key);
+  round_keys[1] = Load(key + kBlockSize);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(2, 0x01);
+  MAIDSAFE_EXPAND_ODD_ROUND_KEY(3);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(4, 0x02);
+  MAIDSAFE_EXPAND_ODD_ROUND_KEY(5);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(6, 0x04);
+  MAIDSAFE_EXPAND_ODD_ROUND_KEY(7);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(8, 0x08);
+  MAIDSAFE_EXPAND_ODD_ROUND_KEY(9);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(10, 0x10);
+  MAIDSAFE_EXPAND_ODD_ROUND_KEY(11);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(12, 0x20);
+  MAIDSAFE_EXPAND_ODD_ROUND_KEY(13);
+  MAIDSAFE_EXPAND_EVEN_ROUND_KEY(14, 0x40);
+}
+
+#undef MAIDSAFE_EXPAND_EVEN_ROUND_KEY
+#undef MAIDSAFE_EXPAND_ODD_ROUND_KEY
+
+MAIDSAFE_AESNI_TARGET inline __m128i EncryptBlock(__m128i block, const __m128i* round_keys) {
+  block = _mm_xor_si128(block, round_keys[0]);
+  for (int round(1); round != kRounds; ++round)
+    block = _mm_aesenc_si128(block, round_keys[round]);
+  return _mm_aesenclast_si128(block, round_keys[kRounds]);
+}
+
+// CFB treats a trailing partial block as a stream cipher, using the start of the keystream.
+MAIDSAFE_AESNI_TARGET void XorPartialBlock(__m128i keystream, byte* data, size_t length) {
+  byte stream[kBlockSize];
+  Store(keystream, stream);
+  for (size_t i(0); i != length; ++i)
+    data[i] ^= stream[i];
+}
+
+MAIDSAFE_AESNI_TARGET void EncryptAesNi(const byte* key, const byte* iv, byte* data,
+                                        size_t length) {
+  __m128i round_keys[kRounds + 1];
+  ExpandKey(key, round_keys);
+  __m128i feedback(Load(iv));
+  size_t offset(0);
+  for (; offset + kBlockSize <= length; offset += kBlockSize) {
+    feedback = _mm_xor_si128(EncryptBlock(feedback, round_keys), Load(data + offset));
+    Store(feedback, data + offset);
+  }
+  if (offset != length)
+    XorPartialBlock(EncryptBlock(feedback, round_keys), data + offset, length - offset);
+}
+
+MAIDSAFE_AESNI_TARGET void DecryptAesNi(const byte* key, const byte* iv, byte* data,
+                                        size_t length) {
+  __m128i round_keys[kRounds + 1];
+  ExpandKey(key, round_keys);
+  __m128i feedback(Load(iv));
+  size_t offset(0);
+  // Each block's keystream is the encryption of the ciphertext before it, so all eight are
+  // independent and their AES rounds can be interleaved.
+  for (; offset + kInterleave * kBlockSize <= length; offset += kInterleave * kBlockSize) {
+    __m128i ciphertext[kInterleave], keystream[kInterleave];
+    for (size_t i(0); i != kInterleave; ++i) {
+      ciphertext[i] = Load(data + offset + i * kBlockSize);
+      keystream[i] = _mm_xor_si128(i == 0 ? feedback : ciphertext[i - 1], round_keys[0]);
+    }
+    for (int round(1); round != kRounds; ++round) {
+      for (size_t i(0); i != kInterleave; ++i)
+        keystream[i] = _mm_aesenc_si128(keystream[i], round_keys[round]);
+    }
+    for (size_t i(0); i != kInterleave; ++i) {
+      keystream[i] = _mm_aesenclast_si128(keystream[i], round_keys[kRounds]);
+      Store(_mm_xor_si128(ciphertext[i], keystream[i]), data + offset + i * kBlockSize);
+    }
+    feedback = ciphertext[kInterleave - 1];
+  }
+  for (; offset + kBlockSize <= length; offset += kBlockSize) {
+    __m128i ciphertext(Load(data + offset));
+    Store(_mm_xor_si128(ciphertext, EncryptBlock(feedback, round_keys)), data + offset);
+    feedback = ciphertext;
+  }
+  if (offset != length)
+    XorPartialBlock(EncryptBlock(feedback, round_keys), data + offset, length - offset);
+}
+
+#undef MAIDSAFE_AESNI_TARGET
+
+#endif  // MAIDSAFE_ENCRYPT_AESNI
+
+}  // unnamed namespace
+
+bool CfbUsesAesNi() {
+#ifdef MAIDSAFE_ENCRYPT_AESNI
+  static const bool kHasAesNi(DetectAesNi());
+  return kHasAesNi;
+#else
+  return false;
+#endif
+}
+
+void CfbEncrypt(const byte* key, const byte* iv, byte* data, size_t length) {
+#ifdef MAIDSAFE_ENCRYPT_AESNI
+  if (CfbUsesAesNi())
+    return EncryptAesNi(key, iv, data, length);
+#endif
+  CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryptor(key, crypto::AES256_KeySize, iv);
+  encryptor.ProcessData(data, data, length);
+}
+
+void CfbDecrypt(const byte* key, const byte* iv, byte* data, size_t length) {
+#ifdef MAIDSAFE_ENCRYPT_AESNI
+  if (CfbUsesAesNi())
+    return DecryptAesNi(key, iv, data, length);
+#endif
+  CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryptor(key, crypto::AES256_KeySize, iv);
+  decryptor.ProcessData(data, data, length);
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,48 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_CFB_H_
+#define MAIDSAFE_ENCRYPT_CFB_H_
+
+#include <cstddef>
+
+#include "maidsafe/common/types.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// AES-256 in CFB mode with 128-bit feedback, processing 'length' bytes of 'data' in place.  The
+// output is identical to CryptoPP::CFB_Mode<CryptoPP::AES>, including for a trailing partial
+// block.  'key' is crypto::AES256_KeySize bytes and 'iv' crypto::AES256_IVSize.
+//
+// Where the processor supports AES-NI the block cipher is run directly rather than through
+// CryptoPP.  Encryption is inherently serial, since each block's keystream is the encryption of
+// the previous ciphertext block, but decryption has all the ciphertext up front so eight blocks
+// are kept in flight at once.
+void CfbEncrypt(const byte* key, const byte* iv, byte* data, size_t length);
+void CfbDecrypt(const byte* key, const byte* iv, byte* data, size_t length);
+
+// Whether the AES-NI kernels are in use.
+bool CfbUsesAesNi();
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_CFB_H_
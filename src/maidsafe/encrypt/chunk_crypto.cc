@@ -0,0 +1,178 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/chunk_crypto.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#ifdef __MSVC__
+#pragma warning(push, 1)
+#endif
+#include "cryptopp/gzip.h"
+#include "cryptopp/sha.h"
+#ifdef __MSVC__
+#pragma warning(pop)
+#endif
+
+#include "maidsafe/common/crypto.h"
+
+#include "maidsafe/encrypt/cfb.h"
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/metrics_recorder.h"
+#include "maidsafe/encrypt/xor.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+// gzip's header and trailer, with room to spare for the final block's header
+const size_t kGzipOverhead(32);
+// Zero chunks of sizes other than kMaxChunkSize kept by GetZeroChunk.
+const size_t kZeroChunkCacheSize(32);
+
+}  // unnamed namespace
+
+void CalculatePreHash(const byte* data, ByteVector& pre_hash) {
+  PhaseTimer timer(Phase::kPreHash, crypto::SHA512::DIGESTSIZE);
+  pre_hash.resize(crypto::SHA512::DIGESTSIZE);
+  CryptoPP::SHA512().CalculateDigest(&pre_hash.data()[0], data, crypto::SHA512::DIGESTSIZE);
+}
+
+const ByteVector& ZeroPreHash() {
+  static const ByteVector kZeroPreHash([] {
+    ByteVector zeros(crypto::SHA512::DIGESTSIZE, 0), pre_hash;
+    CalculatePreHash(&zeros.data()[0], pre_hash);
+    return pre_hash;
+  }());
+  return kZeroPreHash;
+}
+
+void DerivePadIvKey(const ByteVector& pre_hash, const ByteVector& n_1_pre_hash,
+                    const ByteVector& n_2_pre_hash, ChunkKeys& keys) {
+  assert(pre_hash.size() == crypto::SHA512::DIGESTSIZE);
+  assert(n_1_pre_hash.size() == crypto::SHA512::DIGESTSIZE);
+  assert(n_2_pre_hash.size() == crypto::SHA512::DIGESTSIZE);
+  static_assert(kPadSize == (2 * crypto::SHA512::DIGESTSIZE) + crypto::SHA512::DIGESTSIZE -
+                                crypto::AES256_KeySize - crypto::AES256_IVSize,
+                "pad size wrong");
+  auto n_2_iv(std::begin(n_2_pre_hash) + crypto::AES256_KeySize);
+  auto n_2_rest(n_2_iv + crypto::AES256_IVSize);
+  std::copy(std::begin(n_2_pre_hash), n_2_iv, std::begin(keys.key));
+  std::copy(n_2_iv, n_2_rest, std::begin(keys.iv));
+  auto pad(std::copy(std::begin(n_1_pre_hash), std::end(n_1_pre_hash), std::begin(keys.pad)));
+  pad = std::copy(std::begin(pre_hash), std::end(pre_hash), pad);
+  pad = std::copy(n_2_rest, std::end(n_2_pre_hash), pad);
+  assert(pad == std::end(keys.pad) && "pad size incorrect");
+}
+
+std::string EncryptContent(const byte* data, uint32_t length, const ChunkKeys& keys,
+                           std::string& encrypted) {
+  // Each stage runs over the whole chunk in turn so it can be timed on its own; the result is the
+  // same as chaining Gzip, AES-CFB and XORFilter.
+  // Reserved for gzip's worst case, stored blocks of at most 16383 bytes with a 5 byte header
+  // each, so the compressor's output is written once without being moved as the string grows.
+  encrypted.clear();
+  encrypted.reserve(length + 5 * (length / 16383 + 1) + kGzipOverhead);
+  {
+    PhaseTimer timer(Phase::kCompress, length);
+    CryptoPP::Gzip compressor(new CryptoPP::StringSink(encrypted), 1);
+    compressor.Put2(data, length, -1, true);
+    timer.set_bytes_out(encrypted.size());
+  }
+  auto encrypted_data(reinterpret_cast<byte*>(&encrypted[0]));
+  {
+    PhaseTimer timer(Phase::kEncrypt, encrypted.size());
+    CfbEncrypt(keys.key.data(), keys.iv.data(), encrypted_data, encrypted.size());
+  }
+  {
+    PhaseTimer timer(Phase::kXor, encrypted.size());
+    ApplyPad(encrypted_data, encrypted.size(), keys.pad.data());
+  }
+
+  PhaseTimer timer(Phase::kPostHash, encrypted.size());
+  timer.set_bytes_out(crypto::SHA512::DIGESTSIZE);
+  std::string result(crypto::SHA512::DIGESTSIZE, 0);
+  CryptoPP::SHA512().CalculateDigest(reinterpret_cast<byte*>(&result[0]), encrypted_data,
+                                     encrypted.size());
+  return result;
+}
+
+void DecryptContent(const NonEmptyString& content, const ChunkKeys& keys, byte* data,
+                    uint32_t length) {
+  // The reverse of EncryptContent, one stage at a time.  'content' can't be changed, so the pad is
+  // removed while copying it to the one working buffer the later stages run over in place.
+  ByteVector encrypted(content.size());
+  {
+    PhaseTimer timer(Phase::kXor, encrypted.size());
+    ApplyPad(reinterpret_cast<const byte*>(content.data()), &encrypted.data()[0], encrypted.size(),
+             keys.pad.data());
+  }
+  {
+    PhaseTimer timer(Phase::kDecrypt, encrypted.size());
+    CfbDecrypt(keys.key.data(), keys.iv.data(), &encrypted.data()[0], encrypted.size());
+  }
+  PhaseTimer timer(Phase::kDecompress, encrypted.size());
+  timer.set_bytes_out(length);
+  CryptoPP::Gunzip decompressor(new CryptoPP::ArraySink(data, length));
+  decompressor.Put2(&encrypted.data()[0], encrypted.size(), -1, true);
+}
+
+std::shared_ptr<const ZeroChunk> GetZeroChunk(uint32_t size) {
+  static std::mutex mutex;
+  static std::map<uint32_t, std::shared_ptr<const ZeroChunk>> zero_chunks;
+  static std::deque<uint32_t> cached_sizes;  // oldest first, excluding kMaxChunkSize
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto itr(zero_chunks.find(size));
+    if (itr != std::end(zero_chunks))
+      return itr->second;
+  }
+
+  // built unlocked, so that callers wanting other sizes aren't held up behind the encryption
+  ChunkKeys keys;
+  DerivePadIvKey(ZeroPreHash(), ZeroPreHash(), ZeroPreHash(), keys);
+  ByteVector zeros(size, 0);
+  std::shared_ptr<ZeroChunk> zero_chunk(std::make_shared<ZeroChunk>());
+  std::string hash(EncryptContent(&zeros.data()[0], size, keys, zero_chunk->content));
+  zero_chunk->hash.assign(std::begin(hash), std::end(hash));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  // another caller may have built the same chunk meanwhile
+  auto inserted(zero_chunks.emplace(size, zero_chunk));
+  if (!inserted.second)
+    return inserted.first->second;
+  // the full-sized chunk is kept for good; the sizes of smaller chunks vary from file to file
+  if (size != kMaxChunkSize) {
+    if (cached_sizes.size() == kZeroChunkCacheSize) {
+      zero_chunks.erase(cached_sizes.front());
+      cached_sizes.pop_front();
+    }
+    cached_sizes.push_back(size);
+  }
+  return zero_chunk;
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
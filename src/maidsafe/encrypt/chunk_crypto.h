@@ -0,0 +1,78 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_CHUNK_CRYPTO_H_
+#define MAIDSAFE_ENCRYPT_CHUNK_CRYPTO_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/types.h"
+
+#include "maidsafe/encrypt/data_map.h"
+#include "maidsafe/encrypt/xor.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Only the first SHA512::DIGESTSIZE bytes of a chunk feed its pre-hash.
+void CalculatePreHash(const byte* data, ByteVector& pre_hash);
+
+const ByteVector& ZeroPreHash();
+
+// The AES key and IV and the XOR pad with which one chunk is encrypted.
+struct ChunkKeys {
+  std::array<byte, crypto::AES256_KeySize> key;
+  std::array<byte, crypto::AES256_IVSize> iv;
+  std::array<byte, kPadSize> pad;
+};
+
+// Key and IV are taken from the n-2 pre-hash; the pad is n-1, n and the rest of n-2.
+void DerivePadIvKey(const ByteVector& pre_hash, const ByteVector& n_1_pre_hash,
+                    const ByteVector& n_2_pre_hash, ChunkKeys& keys);
+
+// Compresses, encrypts and XORs 'length' bytes of 'data' into 'encrypted'.  Returns the SHA512 of
+// the result, which is the chunk's name.
+std::string EncryptContent(const byte* data, uint32_t length, const ChunkKeys& keys,
+                           std::string& encrypted);
+
+// The reverse of EncryptContent, writing the 'length' bytes of plain text to 'data'.
+void DecryptContent(const NonEmptyString& content, const ChunkKeys& keys, byte* data,
+                    uint32_t length);
+
+struct ZeroChunk {
+  ByteVector hash;
+  std::string content;
+};
+
+// A chunk of '\0's whose two predecessors also have the all-zero pre-hash is encrypted with key
+// material derived purely from ZeroPreHash(), so every such chunk of a given size converges on the
+// same content.  Zero chunks are built once per size and shared, so checking a chunk against one
+// copies nothing.  The full-sized one is kept for the life of the process, along with those of the
+// last few other sizes asked for.
+std::shared_ptr<const ZeroChunk> GetZeroChunk(uint32_t size);
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_CHUNK_CRYPTO_H_
@@ -0,0 +1,84 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_CHUNK_LAYOUT_H_
+#define MAIDSAFE_ENCRYPT_CHUNK_LAYOUT_H_
+
+#include <cstdint>
+
+#include "maidsafe/common/config.h"
+
+#include "maidsafe/encrypt/config.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// How a file of 'file_size' bytes is split into chunks.  Files smaller than 3 * kMinChunkSize
+// have no chunks, being held in DataMap::content; files smaller than 3 * kMaxChunkSize are split
+// into three roughly equal chunks; larger files into kMaxChunkSize chunks, with the penultimate
+// one shortened if needed so that the last is at least kMinChunkSize.
+inline uint32_t NumChunks(uint64_t file_size) {
+  if (file_size < 3 * kMinChunkSize)
+    return 0;
+  if (file_size < 3 * kMaxChunkSize)
+    return 3;
+  if (static_cast<uint32_t>(file_size % kMaxChunkSize == 0))
+    return static_cast<uint32_t>(file_size / kMaxChunkSize);
+  else
+    return static_cast<uint32_t>(file_size / kMaxChunkSize) + 1;
+}
+
+inline uint32_t ChunkSize(uint64_t file_size, uint32_t chunk) {
+  if (file_size < 3 * kMinChunkSize)
+    return 0;
+  if (file_size < 3 * kMaxChunkSize) {
+    if (chunk < 2)
+      return static_cast<uint32_t>(file_size / 3);
+    else
+      return static_cast<uint32_t>(file_size - (2 * (file_size / 3)));
+  }
+  // handle all but last 2 chunks
+  if (chunk < NumChunks(file_size) - 2)
+    return kMaxChunkSize;
+
+  uint32_t remainder(static_cast<uint32_t>(file_size % kMaxChunkSize));
+  bool penultimate((NumChunks(file_size) - 2) == chunk);
+
+  if (remainder == 0)
+    return kMaxChunkSize;
+  // if the last chunk is goind to be less than kMinChunkSize we reduce the penultimate chunk by
+  // kMinChunkSize
+  if (remainder < kMinChunkSize) {
+    if (penultimate)
+      return kMaxChunkSize - kMinChunkSize;
+    else
+      return kMinChunkSize + remainder;
+  } else {
+    if (penultimate)
+      return kMaxChunkSize;
+    else
+      return remainder;
+  }
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_CHUNK_LAYOUT_H_
@@ -0,0 +1,97 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/chunk_sink.h"
+
+#include <utility>
+
+#include "boost/filesystem/fstream.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/identity.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/types.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/metrics_recorder.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace encrypt {
+
+void DataBufferChunkSink::Store(std::vector<EncryptedChunk> batch) {
+  for (auto& chunk : batch) {
+    PhaseTimer timer(Phase::kStore, chunk.content.size());
+    buffer_.Store(DataBuffer::KeyType(Identity(std::move(chunk.name)), DataTypeId(0)),
+                  NonEmptyString(std::move(chunk.content)));
+  }
+}
+
+DirectoryChunkSink::DirectoryChunkSink(fs::path directory) : kDirectory_(std::move(directory)) {
+  boost::system::error_code error_code;
+  fs::create_directories(kDirectory_, error_code);
+  if (error_code || !fs::is_directory(kDirectory_)) {
+    LOG(kError) << "Can't use " << kDirectory_ << " to store chunks: " << error_code.message();
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+  }
+}
+
+void DirectoryChunkSink::Store(std::vector<EncryptedChunk> batch) {
+  for (const auto& chunk : batch) {
+    PhaseTimer timer(Phase::kStore, chunk.content.size());
+    // chunks are content-addressed, so one already there needn't be written again
+    const fs::path kPath(ChunkPath(chunk.name));
+    if (fs::exists(kPath))
+      continue;
+    // written under a temporary name, so a partly written chunk is never mistaken for a whole one
+    fs::path temp_path(kPath);
+    temp_path += ".tmp";
+    {
+      fs::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+      output.write(chunk.content.data(), static_cast<std::streamsize>(chunk.content.size()));
+      if (!output) {
+        LOG(kError) << "Failed to write chunk to " << temp_path;
+        BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+      }
+    }
+    boost::system::error_code error_code;
+    fs::rename(temp_path, kPath, error_code);
+    if (error_code) {
+      LOG(kError) << "Failed to rename " << temp_path << ": " << error_code.message();
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::filesystem_io_error));
+    }
+  }
+}
+
+fs::path DirectoryChunkSink::ChunkPath(const std::string& name) const {
+  return kDirectory_ / HexEncode(name);
+}
+
+void NullChunkSink::Store(std::vector<EncryptedChunk> batch) {
+  ++batch_count_;
+  chunk_count_ += batch.size();
+  for (const auto& chunk : batch)
+    byte_count_ += chunk.content.size();
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,86 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/chunk_sink_queue.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace maidsafe {
+
+namespace encrypt {
+
+ChunkSinkQueue::ChunkSinkQueue(ChunkSink& sink, const ChunkSinkOptions& options)
+    : sink_(sink),
+      kBatchSize_(std::max(options.batch_size, 1U)),
+      mutex_(),
+      batch_(),
+      full_batches_(options.max_pending_batches),
+      worker_() {
+  batch_.reserve(kBatchSize_);
+  worker_ = std::async(std::launch::async, [this] { StoreBatches(); });
+}
+
+ChunkSinkQueue::~ChunkSinkQueue() {
+  if (!worker_.valid())
+    return;
+  full_batches_.Close();
+  worker_.wait();
+}
+
+void ChunkSinkQueue::Add(EncryptedChunk chunk) {
+  std::vector<EncryptedChunk> full_batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch_.push_back(std::move(chunk));
+    if (batch_.size() < kBatchSize_)
+      return;
+    full_batch.reserve(kBatchSize_);
+    std::swap(full_batch, batch_);
+  }
+  // blocks outside the lock, so other threads can go on filling the next batch meanwhile
+  full_batches_.Push(std::move(full_batch));
+}
+
+void ChunkSinkQueue::Flush() {
+  std::vector<EncryptedChunk> last_batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(last_batch, batch_);
+  }
+  if (!last_batch.empty())
+    full_batches_.Push(std::move(last_batch));
+  full_batches_.Close();
+  worker_.get();
+}
+
+void ChunkSinkQueue::StoreBatches() {
+  try {
+    std::vector<EncryptedChunk> batch;
+    while (full_batches_.Pop(batch))
+      sink_.Store(std::move(batch));
+  } catch (...) {
+    // unblocks Add and makes it drop what follows
+    full_batches_.Close();
+    throw;
+  }
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,66 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_CHUNK_SINK_QUEUE_H_
+#define MAIDSAFE_ENCRYPT_CHUNK_SINK_QUEUE_H_
+
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include "maidsafe/encrypt/bounded_queue.h"
+#include "maidsafe/encrypt/chunk_sink.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Gathers chunks from any number of encrypting threads into batches, which a worker thread passes
+// to the sink in the order they filled.  Add blocks while options.max_pending_batches full batches
+// are waiting, so a slow sink holds up encryption rather than letting chunks pile up in memory.
+class ChunkSinkQueue {
+ public:
+  ChunkSinkQueue(ChunkSink& sink, const ChunkSinkOptions& options);
+  // Waits for the worker to store what it has been given, discarding any exception not collected
+  // by Flush.
+  ~ChunkSinkQueue();
+  ChunkSinkQueue(const ChunkSinkQueue&) = delete;
+  ChunkSinkQueue& operator=(const ChunkSinkQueue&) = delete;
+
+  // Once the sink has thrown, chunks are dropped until Flush rethrows its exception.
+  void Add(EncryptedChunk chunk);
+  // Passes on the last, partial batch and waits for the sink to store everything, rethrowing the
+  // first exception it threw.  Nothing may be added afterwards.
+  void Flush();
+
+ private:
+  void StoreBatches();
+
+  ChunkSink& sink_;
+  const uint32_t kBatchSize_;
+  std::mutex mutex_;
+  std::vector<EncryptedChunk> batch_;
+  BoundedQueue<std::vector<EncryptedChunk>> full_batches_;
+  std::future<void> worker_;
+};
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_CHUNK_SINK_QUEUE_H_
@@ -0,0 +1,69 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/chunk_table.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace maidsafe {
+
+namespace encrypt {
+
+ChunkTable::ChunkTable() : statuses_(), size_(0), capacity_(0) {}
+
+void ChunkTable::Resize(uint32_t size, ChunkStatus status) {
+  Reserve(size);
+  for (auto chunk(size_); chunk < size; ++chunk)
+    statuses_[chunk].store(status, std::memory_order_relaxed);
+  size_ = size;
+}
+
+void ChunkTable::Set(uint32_t chunk, ChunkStatus status) {
+  if (chunk >= size_)
+    Resize(chunk + 1);
+  statuses_[chunk].store(status, std::memory_order_release);
+}
+
+bool ChunkTable::Insert(uint32_t chunk, ChunkStatus status) {
+  if (chunk >= size_)
+    Resize(chunk + 1);
+  return Transition(chunk, ChunkStatus::absent, status);
+}
+
+bool ChunkTable::Transition(uint32_t chunk, ChunkStatus expected, ChunkStatus desired) {
+  assert(chunk < size_);
+  return statuses_[chunk].compare_exchange_strong(expected, desired, std::memory_order_acq_rel);
+}
+
+void ChunkTable::Reserve(uint32_t capacity) {
+  if (capacity <= capacity_)
+    return;
+  // grown geometrically, as a file is usually written a chunk at a time
+  capacity = std::max(capacity, capacity_ * 2);
+  std::unique_ptr<std::atomic<ChunkStatus>[]> statuses(new std::atomic<ChunkStatus>[capacity]);
+  for (uint32_t chunk(0); chunk < size_; ++chunk)
+    statuses[chunk].store(statuses_[chunk].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  statuses_ = std::move(statuses);
+  capacity_ = capacity;
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
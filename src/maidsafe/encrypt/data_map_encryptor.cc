@@ -20,11 +20,13 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <future>
 #include <limits>
 #include <set>
 #include <tuple>
 #include <utility>
 #include <memory>
+#include <vector>
 
 #ifdef __MSVC__
 #pragma warning(push, 1)
@@ -48,7 +50,9 @@
 #include "maidsafe/common/utils.h"
 #include "maidsafe/common/serialisation/serialisation.h"
 
+#include "maidsafe/encrypt/cfb.h"
 #include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/parallel.h"
 #include "maidsafe/encrypt/xor.h"
 #include "maidsafe/encrypt/data_map.h"
 
@@ -62,30 +66,53 @@ const EncryptionAlgorithm kDataMapEncryptionVersion =
 
 namespace {
 
-// SHA512 of 'parent_id' concatenated with 'this_id'
-ByteVector GetEncryptionHash(const Identity& parent_id, const Identity& this_id) {
-  ByteVector encryption_input(parent_id.string());
-  encryption_input.reserve(identity_size * 2);
-  const ByteVector& this_id_str(this_id.string());
-  encryption_input.insert(encryption_input.end(), this_id_str.begin(), this_id_str.end());
-  ByteVector encryption_hash(crypto::SHA512::DIGESTSIZE);
-  CryptoPP::SHA512().CalculateDigest(&encryption_hash.data()[0], encryption_input.data(),
-                                     encryption_input.size());
-  return encryption_hash;
-}
+// Derives the per-map key material for children of one parent: the encryption hash is
+// SHA512(parent_id + this_id) and the xor hash is SHA512(this_id + parent_id).  The two ids
+// together fit in one SHA-512 block, so there is no hash state worth sharing between children; the
+// batch functions gain only from hashing and encrypting the maps in parallel.
+class ParentKeys {
+ public:
+  explicit ParentKeys(const Identity& parent_id) : parent_id_(parent_id) {
+    assert(parent_id.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
+  }
+
+  ByteVector EncryptionHash(const Identity& this_id) const { return Hash(parent_id_, this_id); }
+
+  ByteVector XorHash(const Identity& this_id) const { return Hash(this_id, parent_id_); }
+
+ private:
+  static ByteVector Hash(const Identity& first, const Identity& second) {
+    assert(first.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
+    assert(second.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
+    CryptoPP::SHA512 hash;
+    hash.Update(first.string().data(), first.string().size());
+    hash.Update(second.string().data(), second.string().size());
+    ByteVector digest(crypto::SHA512::DIGESTSIZE);
+    hash.Final(&digest.data()[0]);
+    return digest;
+  }
+
+  const Identity parent_id_;
+};
+
+SerialisedData EncryptUsingKeys(const ParentKeys& keys, const Identity& this_id,
+                                const DataMap& data_map) {
+  SerialisedData serialised_data_map(Serialise(data_map));
+  ByteVector encryption_hash(keys.EncryptionHash(this_id));
+  ByteVector xor_hash(keys.XorHash(this_id));
+  // encrypted then XORed in place; the same as chaining AES-CFB and XORFilter
+  std::string encrypted_data_map(std::begin(serialised_data_map), std::end(serialised_data_map));
+  auto data(reinterpret_cast<byte*>(&encrypted_data_map[0]));
+  CfbEncrypt(&encryption_hash.data()[0], &encryption_hash.data()[crypto::AES256_KeySize], data,
+             encrypted_data_map.size());
+  ApplyPad(data, encrypted_data_map.size(), &xor_hash.data()[0], crypto::SHA512::DIGESTSIZE);
 
-// SHA512 of 'this_id' concatenated with 'parent_id'
-ByteVector GetXorHash(const Identity& parent_id, const Identity& this_id) {
-  ByteVector xor_input(this_id.string());
-  xor_input.reserve(identity_size * 2);
-  const ByteVector& parent_id_str(parent_id.string());
-  xor_input.insert(xor_input.end(), parent_id_str.begin(), parent_id_str.end());
-  ByteVector xor_hash(crypto::SHA512::DIGESTSIZE);
-  CryptoPP::SHA512().CalculateDigest(&xor_hash.data()[0], xor_input.data(), xor_input.size());
-  return xor_hash;
+  assert(!encrypted_data_map.empty());
+
+  return Serialise(kDataMapEncryptionVersion, encrypted_data_map);
 }
 
-DataMap DecryptUsingVersion0(const Identity& parent_id, const Identity& this_id,
+DataMap DecryptUsingVersion0(const ParentKeys& keys, const Identity& this_id,
                              const SerialisedData& encrypted_data_map) {
   EncryptionAlgorithm data_map_encryption_version;
   std::string encrypted_data_map_str;
@@ -94,64 +121,75 @@ DataMap DecryptUsingVersion0(const Identity& parent_id, const Identity& this_id,
   if (data_map_encryption_version != EncryptionAlgorithm::kDataMapEncryptionVersion0)
     BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::invalid_encryption_version));
 
-  ByteVector encryption_hash(GetEncryptionHash(parent_id, this_id));
-  ByteVector xor_hash(GetXorHash(parent_id, this_id));
-  CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryptor(
-      &encryption_hash.data()[0], crypto::AES256_KeySize,
-      &encryption_hash.data()[crypto::AES256_KeySize]);
-
-  std::string serialised_data_map;
-  CryptoPP::StringSource filter(
-      encrypted_data_map_str, true,
-      new XORFilter(new CryptoPP::StreamTransformationFilter(
-                        decryptor, new CryptoPP::StringSink(serialised_data_map)),
-                    &xor_hash.data()[0], crypto::SHA512::DIGESTSIZE));
-
-  return ConvertFromString<DataMap>(serialised_data_map);
-}
-
-}  // unnamed namespace
-
-SerialisedData EncryptDataMap(const Identity& parent_id, const Identity& this_id,
-                              const DataMap& data_map) {
-  assert(parent_id.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
-  assert(this_id.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
-
-  SerialisedData serialised_data_map(Serialise(data_map));
-  ByteVector encryption_hash(GetEncryptionHash(parent_id, this_id));
-  ByteVector xor_hash(GetXorHash(parent_id, this_id));
-  CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryptor(
-      &encryption_hash.data()[0], crypto::AES256_KeySize,
-      &encryption_hash.data()[crypto::AES256_KeySize]);
-
-  std::string encrypted_data_map;
-  CryptoPP::StreamTransformationFilter aes_filter(
-      encryptor, new XORFilter(new CryptoPP::StringSink(encrypted_data_map), &xor_hash.data()[0],
-                               crypto::SHA512::DIGESTSIZE));
-  aes_filter.Put2(&serialised_data_map.data()[0], serialised_data_map.size(), -1, true);
-
-  assert(!encrypted_data_map.empty());
+  ByteVector encryption_hash(keys.EncryptionHash(this_id));
+  ByteVector xor_hash(keys.XorHash(this_id));
+  // XORed then decrypted in place
+  auto data(reinterpret_cast<byte*>(&encrypted_data_map_str[0]));
+  ApplyPad(data, encrypted_data_map_str.size(), &xor_hash.data()[0], crypto::SHA512::DIGESTSIZE);
+  CfbDecrypt(&encryption_hash.data()[0], &encryption_hash.data()[crypto::AES256_KeySize], data,
+             encrypted_data_map_str.size());
 
-  return Serialise(kDataMapEncryptionVersion, encrypted_data_map);
+  return ConvertFromString<DataMap>(encrypted_data_map_str);
 }
 
-DataMap DecryptDataMap(const Identity& parent_id, const Identity& this_id,
-                       const SerialisedData& encrypted_data_map) {
-  assert(parent_id.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
-  assert(this_id.string().size() == static_cast<size_t>(crypto::SHA512::DIGESTSIZE));
+DataMap DecryptUsingKeys(const ParentKeys& keys, const Identity& this_id,
+                         const SerialisedData& encrypted_data_map) {
   assert(!encrypted_data_map.empty());
 
   // Don't switch here - just assume most current encryption version is being used and try
   // progressively older versions until one works
   // try {
-  //   return DecryptUsingVersion1(parent_id, this_id, encrypted_data_map);
+  //   return DecryptUsingVersion1(keys, this_id, encrypted_data_map);
   // }
   // catch (const encrypt_error& error) {
   //   if (error.code() != MakeError(EncryptErrors::invalid_encryption_version).code())
   //     throw;
   // }
 
-  return DecryptUsingVersion0(parent_id, this_id, encrypted_data_map);
+  return DecryptUsingVersion0(keys, this_id, encrypted_data_map);
+}
+
+}  // unnamed namespace
+
+SerialisedData EncryptDataMap(const Identity& parent_id, const Identity& this_id,
+                              const DataMap& data_map) {
+  return EncryptUsingKeys(ParentKeys(parent_id), this_id, data_map);
+}
+
+DataMap DecryptDataMap(const Identity& parent_id, const Identity& this_id,
+                       const SerialisedData& encrypted_data_map) {
+  return DecryptUsingKeys(ParentKeys(parent_id), this_id, encrypted_data_map);
+}
+
+std::vector<SerialisedData> EncryptDataMaps(const Identity& parent_id,
+                                            const std::vector<Identity>& this_ids,
+                                            const std::vector<DataMap>& data_maps) {
+  if (this_ids.size() != data_maps.size()) {
+    LOG(kError) << this_ids.size() << " IDs provided for " << data_maps.size() << " data maps.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  const ParentKeys keys(parent_id);
+  std::vector<SerialisedData> encrypted_data_maps(data_maps.size());
+  ForEachInParallel(data_maps.size(), [&](size_t i) {
+    encrypted_data_maps[i] = EncryptUsingKeys(keys, this_ids[i], data_maps[i]);
+  });
+  return encrypted_data_maps;
+}
+
+std::vector<DataMap> DecryptDataMaps(const Identity& parent_id,
+                                     const std::vector<Identity>& this_ids,
+                                     const std::vector<SerialisedData>& encrypted_data_maps) {
+  if (this_ids.size() != encrypted_data_maps.size()) {
+    LOG(kError) << this_ids.size() << " IDs provided for " << encrypted_data_maps.size()
+                << " encrypted data maps.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  const ParentKeys keys(parent_id);
+  std::vector<DataMap> data_maps(encrypted_data_maps.size());
+  ForEachInParallel(encrypted_data_maps.size(), [&](size_t i) {
+    data_maps[i] = DecryptUsingKeys(keys, this_ids[i], encrypted_data_maps[i]);
+  });
+  return data_maps;
 }
 
 }  // namespace encrypt
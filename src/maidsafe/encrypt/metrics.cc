@@ -0,0 +1,271 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include "boost/thread/tss.hpp"
+
+#include "maidsafe/encrypt/metrics_recorder.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+struct PhaseCounters {
+  std::atomic<uint64_t> count, bytes_in, bytes_out, total_nanoseconds;
+  std::array<std::atomic<uint64_t>, kLatencyBucketCount> latency_histogram;
+};
+
+// Only ever written by the owning thread, so no read-modify-write instructions are needed.
+struct ThreadCounters {
+  ThreadCounters() {
+    for (auto& phase : phases) {
+      phase.count = phase.bytes_in = phase.bytes_out = phase.total_nanoseconds = 0;
+      for (auto& bucket : phase.latency_histogram)
+        bucket = 0;
+    }
+    chunks_encrypted = chunks_reencrypted = 0;
+  }
+
+  std::array<PhaseCounters, kPhaseCount> phases;
+  std::atomic<uint64_t> chunks_encrypted, chunks_reencrypted;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::set<ThreadCounters*> live;
+  MetricsSnapshot retired;   // totals from threads which have exited
+  MetricsSnapshot baseline;  // totals at the last ResetMetrics
+};
+
+std::atomic<int64_t> g_sequencer_bytes(0);
+std::atomic<uint64_t> g_sequencer_high_water_mark(0);
+
+// Never destroyed, since threads may exit during static destruction.
+Registry& GetRegistry() {
+  static Registry* registry(new Registry);
+  return *registry;
+}
+
+void Increment(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t Load(const std::atomic<uint64_t>& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+size_t LatencyBucket(uint64_t nanoseconds) {
+  size_t bucket(0);
+  while (nanoseconds > 1 && bucket + 1 < kLatencyBucketCount) {
+    nanoseconds >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+// Applies 'op' to every counter of 'lhs' and the corresponding counter of 'rhs'.
+template <typename Op>
+void Combine(MetricsSnapshot& lhs, const MetricsSnapshot& rhs, Op op) {
+  for (size_t i(0); i < kPhaseCount; ++i) {
+    op(lhs.phases[i].count, rhs.phases[i].count);
+    op(lhs.phases[i].bytes_in, rhs.phases[i].bytes_in);
+    op(lhs.phases[i].bytes_out, rhs.phases[i].bytes_out);
+    op(lhs.phases[i].total_nanoseconds, rhs.phases[i].total_nanoseconds);
+    for (size_t j(0); j < kLatencyBucketCount; ++j)
+      op(lhs.phases[i].latency_histogram[j], rhs.phases[i].latency_histogram[j]);
+  }
+  op(lhs.chunks_encrypted, rhs.chunks_encrypted);
+  op(lhs.chunks_reencrypted, rhs.chunks_reencrypted);
+}
+
+void Add(MetricsSnapshot& total, const ThreadCounters& counters) {
+  MetricsSnapshot snapshot;
+  for (size_t i(0); i < kPhaseCount; ++i) {
+    snapshot.phases[i].count = Load(counters.phases[i].count);
+    snapshot.phases[i].bytes_in = Load(counters.phases[i].bytes_in);
+    snapshot.phases[i].bytes_out = Load(counters.phases[i].bytes_out);
+    snapshot.phases[i].total_nanoseconds = Load(counters.phases[i].total_nanoseconds);
+    for (size_t j(0); j < kLatencyBucketCount; ++j)
+      snapshot.phases[i].latency_histogram[j] = Load(counters.phases[i].latency_histogram[j]);
+  }
+  snapshot.chunks_encrypted = Load(counters.chunks_encrypted);
+  snapshot.chunks_reencrypted = Load(counters.chunks_reencrypted);
+  Combine(total, snapshot, [](uint64_t& lhs, uint64_t rhs) { lhs += rhs; });
+}
+
+// Caller must hold the registry's mutex.
+MetricsSnapshot Totals(const Registry& registry) {
+  MetricsSnapshot totals(registry.retired);
+  for (const auto& counters : registry.live)
+    Add(totals, *counters);
+  return totals;
+}
+
+void RetireThreadCounters(ThreadCounters* counters) {
+  Registry& registry(GetRegistry());
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  Add(registry.retired, *counters);
+  registry.live.erase(counters);
+  delete counters;
+}
+
+ThreadCounters& GetThreadCounters() {
+  static auto* thread_counters(
+      new boost::thread_specific_ptr<ThreadCounters>(RetireThreadCounters));
+  if (!thread_counters->get()) {
+    auto counters(new ThreadCounters);
+    {
+      Registry& registry(GetRegistry());
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      registry.live.insert(counters);
+    }
+    thread_counters->reset(counters);
+  }
+  return *thread_counters->get();
+}
+
+}  // unnamed namespace
+
+const char* PhaseName(Phase phase) {
+  switch (phase) {
+    case Phase::kPreHash:
+      return "pre-hash";
+    case Phase::kCompress:
+      return "compress";
+    case Phase::kEncrypt:
+      return "encrypt";
+    case Phase::kXor:
+      return "xor";
+    case Phase::kPostHash:
+      return "post-hash";
+    case Phase::kStore:
+      return "store";
+    case Phase::kFetch:
+      return "fetch";
+    case Phase::kDecrypt:
+      return "decrypt";
+    case Phase::kDecompress:
+      return "decompress";
+    default:
+      return "unknown";
+  }
+}
+
+uint64_t PhaseMetrics::LatencyPercentile(double percentile) const {
+  if (count == 0)
+    return 0;
+  auto target(static_cast<uint64_t>(std::ceil(percentile * count)));
+  uint64_t cumulative(0);
+  for (size_t i(0); i < kLatencyBucketCount - 1; ++i) {
+    cumulative += latency_histogram[i];
+    if (cumulative >= target)
+      return uint64_t(2) << i;
+  }
+  return std::numeric_limits<uint64_t>::max();
+}
+
+double MetricsSnapshot::CompressionRatio() const {
+  const PhaseMetrics& compress((*this)[Phase::kCompress]);
+  return compress.bytes_in == 0 ? 0.0 : static_cast<double>(compress.bytes_out) /
+                                            static_cast<double>(compress.bytes_in);
+}
+
+std::string MetricsSnapshot::ToString() const {
+  std::ostringstream stream;
+  stream << std::left << std::setw(12) << "phase" << std::right << std::setw(10) << "count"
+         << std::setw(16) << "bytes in" << std::setw(16) << "bytes out" << std::setw(12)
+         << "mean us" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << '\n';
+  stream << std::fixed << std::setprecision(1);
+  for (size_t i(0); i < kPhaseCount; ++i) {
+    const PhaseMetrics& phase(phases[i]);
+    stream << std::left << std::setw(12) << PhaseName(static_cast<Phase>(i)) << std::right
+           << std::setw(10) << phase.count << std::setw(16) << phase.bytes_in << std::setw(16)
+           << phase.bytes_out << std::setw(12)
+           << (phase.count == 0 ? 0.0 : phase.total_nanoseconds / 1000.0 / phase.count)
+           << std::setw(12) << phase.LatencyPercentile(0.5) / 1000.0 << std::setw(12)
+           << phase.LatencyPercentile(0.99) / 1000.0 << '\n';
+  }
+  stream << std::setprecision(3) << "chunks encrypted: " << chunks_encrypted << " ("
+         << chunks_reencrypted << " re-encrypted), compression ratio: " << CompressionRatio()
+         << '\n' << "sequencer bytes: " << sequencer_bytes << " (high-water mark "
+         << sequencer_high_water_mark << ")\n";
+  return stream.str();
+}
+
+MetricsSnapshot GetMetrics() {
+  Registry& registry(GetRegistry());
+  MetricsSnapshot snapshot;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    snapshot = Totals(registry);
+    Combine(snapshot, registry.baseline, [](uint64_t& lhs, uint64_t rhs) { lhs -= rhs; });
+  }
+  snapshot.sequencer_bytes = static_cast<uint64_t>(std::max<int64_t>(g_sequencer_bytes, 0));
+  snapshot.sequencer_high_water_mark = g_sequencer_high_water_mark;
+  return snapshot;
+}
+
+void ResetMetrics() {
+  Registry& registry(GetRegistry());
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.baseline = Totals(registry);
+  g_sequencer_high_water_mark = static_cast<uint64_t>(std::max<int64_t>(g_sequencer_bytes, 0));
+}
+
+void RecordPhase(Phase phase, uint64_t bytes_in, uint64_t bytes_out,
+                 std::chrono::nanoseconds duration) {
+  auto nanoseconds(static_cast<uint64_t>(std::max<std::chrono::nanoseconds::rep>(
+      duration.count(), 0)));
+  PhaseCounters& counters(GetThreadCounters().phases[static_cast<size_t>(phase)]);
+  Increment(counters.count, 1);
+  Increment(counters.bytes_in, bytes_in);
+  Increment(counters.bytes_out, bytes_out);
+  Increment(counters.total_nanoseconds, nanoseconds);
+  Increment(counters.latency_histogram[LatencyBucket(nanoseconds)], 1);
+}
+
+void RecordChunkEncrypted(bool reencrypted) {
+  ThreadCounters& counters(GetThreadCounters());
+  Increment(counters.chunks_encrypted, 1);
+  if (reencrypted)
+    Increment(counters.chunks_reencrypted, 1);
+}
+
+void RecordSequencerBytes(int64_t delta) {
+  auto bytes(static_cast<uint64_t>(std::max<int64_t>(g_sequencer_bytes += delta, 0)));
+  auto high_water_mark(g_sequencer_high_water_mark.load());
+  while (bytes > high_water_mark &&
+         !g_sequencer_high_water_mark.compare_exchange_weak(high_water_mark, bytes)) {
+  }
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,65 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_METRICS_RECORDER_H_
+#define MAIDSAFE_ENCRYPT_METRICS_RECORDER_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "maidsafe/encrypt/metrics.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+void RecordPhase(Phase phase, uint64_t bytes_in, uint64_t bytes_out,
+                 std::chrono::nanoseconds duration);
+void RecordChunkEncrypted(bool reencrypted);
+// 'delta' is the change in bytes allocated by a sequencer.
+void RecordSequencerBytes(int64_t delta);
+
+// Records the time from construction to destruction against 'phase'.
+class PhaseTimer {
+ public:
+  PhaseTimer(Phase phase, uint64_t bytes_in)
+      : kPhase_(phase),
+        kBytesIn_(bytes_in),
+        bytes_out_(bytes_in),
+        kStart_(std::chrono::steady_clock::now()) {}
+  ~PhaseTimer() {
+    RecordPhase(kPhase_, kBytesIn_, bytes_out_, std::chrono::steady_clock::now() - kStart_);
+  }
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+  // Defaults to bytes_in, i.e. for phases which don't change the length.
+  void set_bytes_out(uint64_t bytes_out) { bytes_out_ = bytes_out; }
+
+ private:
+  const Phase kPhase_;
+  const uint64_t kBytesIn_;
+  uint64_t bytes_out_;
+  const std::chrono::steady_clock::time_point kStart_;
+};
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_METRICS_RECORDER_H_
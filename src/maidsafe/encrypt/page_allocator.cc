@@ -0,0 +1,119 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/page_allocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "maidsafe/common/log.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+const size_t kHugePageSize(2 * 1024 * 1024);
+
+std::atomic<PagePolicy> g_page_policy(PagePolicy::kStandard);
+
+bool UsesStandardAllocator(size_t size, PagePolicy policy) {
+#if defined(__linux__)
+  return policy == PagePolicy::kStandard || size < kHugePageSize;
+#else
+  static_cast<void>(size);
+  static_cast<void>(policy);
+  return true;
+#endif
+}
+
+#if defined(__linux__)
+size_t MappedLength(size_t size) {
+  return ((size + kHugePageSize - 1) / kHugePageSize) * kHugePageSize;
+}
+
+// Maps 'length' bytes aligned to kHugePageSize by over-mapping and trimming both ends, so that the
+// kernel can back the whole range with transparent huge pages.
+void* MapAligned(size_t length) {
+  void* raw(mmap(nullptr, length + kHugePageSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (raw == MAP_FAILED)
+    throw std::bad_alloc();
+  auto start(reinterpret_cast<uintptr_t>(raw));
+  auto aligned((start + kHugePageSize - 1) & ~(static_cast<uintptr_t>(kHugePageSize) - 1));
+  if (aligned != start)
+    munmap(raw, aligned - start);
+  auto tail(start + length + kHugePageSize - (aligned + length));
+  if (tail != 0)
+    munmap(reinterpret_cast<void*>(aligned + length), tail);
+  madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+  return reinterpret_cast<void*>(aligned);
+}
+#endif
+
+}  // unnamed namespace
+
+void SetPagePolicy(PagePolicy policy) { g_page_policy = policy; }
+
+PagePolicy GetPagePolicy() { return g_page_policy; }
+
+size_t HugePageSize() { return kHugePageSize; }
+
+namespace detail {
+
+void* AllocatePages(size_t size, PagePolicy policy) {
+  if (UsesStandardAllocator(size, policy))
+    return ::operator new(size);
+#if defined(__linux__)
+  size_t length(MappedLength(size));
+  if (policy == PagePolicy::kExplicitHuge) {
+    void* ptr(mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0));
+    if (ptr != MAP_FAILED)
+      return ptr;
+    static std::atomic<bool> logged(false);
+    if (!logged.exchange(true))
+      LOG(kWarning) << "No explicit huge pages available, falling back to transparent huge pages.";
+  }
+  return MapAligned(length);
+#else
+  return nullptr;
+#endif
+}
+
+void DeallocatePages(void* ptr, size_t size, PagePolicy policy) {
+  if (!ptr)
+    return;
+  if (UsesStandardAllocator(size, policy))
+    return ::operator delete(ptr);
+#if defined(__linux__)
+  munmap(ptr, MappedLength(size));
+#endif
+}
+
+}  // namespace detail
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,60 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#ifndef MAIDSAFE_ENCRYPT_PARALLEL_H_
+#define MAIDSAFE_ENCRYPT_PARALLEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+#include "maidsafe/common/utils.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+// Splits [0, count) into contiguous ranges across up to Concurrency() tasks, running
+// 'functor(begin, end)' once per range.  The first exception thrown by any task is rethrown.
+template <typename Functor>
+void ForEachRangeInParallel(size_t count, Functor functor) {
+  auto task_count(std::min(count, static_cast<size_t>(std::max(Concurrency(), 1))));
+  std::vector<std::future<void>> fut;
+  for (size_t task(0); task < task_count; ++task) {
+    size_t begin(count * task / task_count), end(count * (task + 1) / task_count);
+    fut.emplace_back(std::async(std::launch::async, [=] { functor(begin, end); }));
+  }
+  for (auto& res : fut)
+    res.get();
+}
+
+// Runs 'functor(i)' for each i in [0, count), split as for ForEachRangeInParallel.
+template <typename Functor>
+void ForEachInParallel(size_t count, Functor functor) {
+  ForEachRangeInParallel(count, [functor](size_t begin, size_t end) {
+    for (auto i(begin); i < end; ++i)
+      functor(i);
+  });
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_ENCRYPT_PARALLEL_H_
@@ -0,0 +1,226 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/restore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/bounded_queue.h"
+#include "maidsafe/encrypt/chunk_crypto.h"
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/metrics_recorder.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+struct FetchedChunk {
+  FetchedChunk() : index(0), zero(false), content() {}
+  explicit FetchedChunk(uint32_t index_in) : index(index_in), zero(false), content() {}
+
+  uint32_t index;
+  bool zero;  // a chunk of '\0's, so not fetched
+  NonEmptyString content;
+};
+
+struct PlainChunk {
+  PlainChunk() : index(0), data() {}
+  PlainChunk(uint32_t index_in, uint32_t size) : index(index_in), data(size) {}
+
+  uint32_t index;
+  ByteVector data;
+};
+
+bool IsZeroChunk(const ChunkDetails& chunk) {
+  return chunk.pre_hash == ZeroPreHash() && chunk.hash == GetZeroChunk(chunk.size)->hash;
+}
+
+void DecryptChunk(const std::vector<ChunkDetails>& chunks, const FetchedChunk& fetched,
+                  PlainChunk& plain) {
+  if (fetched.zero)
+    return;
+  auto chunk_count(static_cast<uint32_t>(chunks.size()));
+  uint32_t n_1_chunk((chunk_count + fetched.index - 1) % chunk_count);
+  uint32_t n_2_chunk((chunk_count + fetched.index - 2) % chunk_count);
+  ChunkKeys keys;
+  DerivePadIvKey(chunks[fetched.index].pre_hash, chunks[n_1_chunk].pre_hash,
+                 chunks[n_2_chunk].pre_hash, keys);
+  DecryptContent(fetched.content, keys, &plain.data.data()[0],
+                 static_cast<uint32_t>(plain.data.size()));
+}
+
+}  // unnamed namespace
+
+RestoreOptions::RestoreOptions()
+    : fetch_threads(4),
+      fetched_queue_depth(8),
+      decrypt_threads(static_cast<uint32_t>(std::max(Concurrency(), 1))),
+      decrypted_queue_depth(8) {}
+
+void Restore(const DataMap& data_map,
+             std::function<NonEmptyString(const std::string&)> get_from_store,
+             std::function<void(const char* data, uint32_t length, uint64_t position)> sink,
+             const RestoreOptions& options) {
+  if (!get_from_store || !sink) {
+    LOG(kError) << "Need non-null get_from_store and sink functors.";
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+  }
+  const auto& chunks(data_map.chunks);
+  if (chunks.empty()) {
+    if (!data_map.content.empty()) {
+      sink(reinterpret_cast<const char*>(&data_map.content.data()[0]),
+           static_cast<uint32_t>(data_map.content.size()), 0);
+    }
+    return;
+  }
+
+  const auto kChunkCount(static_cast<uint32_t>(chunks.size()));
+  const uint32_t kFetchThreads(std::max(options.fetch_threads, 1U));
+  const uint32_t kDecryptThreads(std::max(options.decrypt_threads, 1U));
+  BoundedQueue<FetchedChunk> fetched(options.fetched_queue_depth);
+  BoundedQueue<PlainChunk> decrypted(options.decrypted_queue_depth);
+
+  // Fetchers claim chunks in order, but no more than kWindow past the next chunk due at the sink.
+  // This bounds the chunks held in 'pending' if one chunk's fetch stalls while the rest complete.
+  const uint32_t kWindow(kFetchThreads + options.fetched_queue_depth + kDecryptThreads +
+                         options.decrypted_queue_depth);
+  std::mutex window_mutex;
+  std::condition_variable window_moved;
+  uint32_t next_fetch(0), next_chunk(0);
+  bool stopped(false);
+  auto claim([&](uint32_t& index) {
+    std::unique_lock<std::mutex> lock(window_mutex);
+    window_moved.wait(lock, [&] {
+      return stopped || next_fetch >= kChunkCount || next_fetch < next_chunk + kWindow;
+    });
+    if (stopped || next_fetch >= kChunkCount)
+      return false;
+    index = next_fetch++;
+    return true;
+  });
+  auto stop([&] {
+    {
+      std::lock_guard<std::mutex> lock(window_mutex);
+      stopped = true;
+    }
+    window_moved.notify_all();
+    fetched.Close();
+    decrypted.Close();
+  });
+
+  // Each stage closes its output queue when its last thread finishes, or closes both queues
+  // straight away if it throws, which unblocks every other stage.
+  std::atomic<uint32_t> running_fetchers(kFetchThreads);
+  std::vector<std::future<void>> stages;
+  for (uint32_t i(0); i < kFetchThreads; ++i) {
+    stages.emplace_back(std::async(std::launch::async, [&] {
+      try {
+        uint32_t index(0);
+        while (claim(index)) {
+          FetchedChunk chunk(index);
+          chunk.zero = IsZeroChunk(chunks[index]);
+          if (!chunk.zero) {
+            PhaseTimer timer(Phase::kFetch, 0);
+            chunk.content = get_from_store(
+                std::string(std::begin(chunks[index].hash), std::end(chunks[index].hash)));
+            timer.set_bytes_out(chunk.content.size());
+          }
+          if (!fetched.Push(std::move(chunk)))
+            return;
+        }
+      } catch (...) {
+        stop();
+        throw;
+      }
+      if (--running_fetchers == 0)
+        fetched.Close();
+    }));
+  }
+
+  std::atomic<uint32_t> running_decryptors(kDecryptThreads);
+  for (uint32_t i(0); i < kDecryptThreads; ++i) {
+    stages.emplace_back(std::async(std::launch::async, [&] {
+      try {
+        FetchedChunk chunk;
+        while (fetched.Pop(chunk)) {
+          PlainChunk plain(chunk.index, chunks[chunk.index].size);
+          DecryptChunk(chunks, chunk, plain);
+          if (!decrypted.Push(std::move(plain)))
+            return;
+        }
+      } catch (...) {
+        stop();
+        throw;
+      }
+      if (--running_decryptors == 0)
+        decrypted.Close();
+    }));
+  }
+
+  // Chunks arrive out of order, so are held here until the sink can take them.  Only this thread
+  // writes next_chunk, so it reads it without the lock.
+  std::map<uint32_t, ByteVector> pending;
+  uint64_t position(0);
+  try {
+    PlainChunk plain;
+    while (next_chunk < kChunkCount && decrypted.Pop(plain)) {
+      pending.insert(std::make_pair(plain.index, std::move(plain.data)));
+      for (auto itr(pending.find(next_chunk)); itr != std::end(pending);
+           itr = pending.find(next_chunk)) {
+        sink(reinterpret_cast<const char*>(&itr->second.data()[0]),
+             static_cast<uint32_t>(itr->second.size()), position);
+        position += itr->second.size();
+        pending.erase(itr);
+        {
+          std::lock_guard<std::mutex> lock(window_mutex);
+          ++next_chunk;
+        }
+        window_moved.notify_all();
+      }
+    }
+  } catch (...) {
+    stop();
+    for (auto& stage : stages)
+      stage.wait();
+    throw;
+  }
+  stop();
+  for (auto& stage : stages)
+    stage.get();
+  if (next_chunk != kChunkCount) {
+    LOG(kError) << "Restored only " << next_chunk << " of " << kChunkCount << " chunks.";
+    BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::failed_to_decrypt));
+  }
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
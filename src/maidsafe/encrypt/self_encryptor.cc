@@ -20,6 +20,8 @@
 
 #include <algorithm>
 #include <limits>
+#include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <memory>
@@ -39,6 +41,7 @@
 #endif
 
 #include "boost/exception/all.hpp"
+#include "boost/thread/locks.hpp"
 
 #include "maidsafe/common/config.h"
 #include "maidsafe/common/crypto.h"
@@ -51,233 +54,743 @@
 #include "maidsafe/common/utils.h"
 
 #include "maidsafe/encrypt/data_map_encryptor.h"
+#include "maidsafe/encrypt/chunk_crypto.h"
+#include "maidsafe/encrypt/chunk_layout.h"
+#include "maidsafe/encrypt/chunk_sink_queue.h"
 #include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/metrics_recorder.h"
+#include "maidsafe/encrypt/parallel.h"
 #include "maidsafe/encrypt/xor.h"
 
 namespace maidsafe {
 
 namespace encrypt {
 
+namespace {
+
+// Reads spanning fewer whole remote chunks than this aren't worth splitting across tasks.
+const size_t kMinScatterReadChunks(2);
+
+}  // unnamed namespace
+
 SelfEncryptor::SelfEncryptor(DataMap& data_map, DataBuffer& buffer,
                              std::function<NonEmptyString(const std::string&)> get_from_store)
+    : SelfEncryptor(data_map, std::unique_ptr<ChunkSink>(new DataBufferChunkSink(buffer)), nullptr,
+                    std::move(get_from_store), ChunkSinkOptions()) {}
+
+SelfEncryptor::SelfEncryptor(DataMap& data_map, ChunkSink& sink,
+                             std::function<NonEmptyString(const std::string&)> get_from_store,
+                             const ChunkSinkOptions& sink_options)
+    : SelfEncryptor(data_map, nullptr, &sink, std::move(get_from_store), sink_options) {}
+
+SelfEncryptor::SelfEncryptor(DataMap& data_map, std::unique_ptr<ChunkSink> owned_sink,
+                             ChunkSink* sink,
+                             std::function<NonEmptyString(const std::string&)> get_from_store,
+                             const ChunkSinkOptions& sink_options)
     : data_map_(data_map),
-      kOriginalDataMap_(data_map),
-      sequencer_(kMaxChunkSize * 3),  // space for  min first 3 chunks
+      undo_journal_(data_map),
+      sequencer_(),
+      small_file_mode_(data_map.chunks.empty()),
+      small_file_content_(data_map.chunks.empty() ? data_map.content : ByteVector()),
       chunks_(),
-      buffer_(buffer),
+      chunk_keys_(data_map.chunks.size()),
+      owned_sink_(std::move(owned_sink)),
+      sink_(sink ? *sink : *owned_sink_),
+      kSinkOptions_(sink_options),
       get_from_store_(get_from_store),
       file_size_(data_map.size()),
+      truncated_size_(std::numeric_limits<uint64_t>::max()),
+      modified_(false),
       closed_(false),
+      readable_after_close_(false),
+      finalisation_(),
+      file_mutex_(),
+      sequencer_mutex_(),
+      chunk_mutexes_(),
+      rollback_mutex_(),
+      rollback_gate_(),
       data_mutex_() {
   if (!get_from_store) {
     LOG(kError) << "Need to have a non-null get_from_store functor.";
     BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
   }
-  auto pos(0);
+  uint64_t pos(0);
   if (!data_map_.chunks.empty()) {
     assert(data_map_.chunks.size() >= 3);
-    for (uint32_t i(0); i < data_map_.chunks.size(); ++i)
-      chunks_.insert(std::make_pair(i, ChunkStatus::remote));
-    for (uint32_t i(0); i < data_map_.chunks.size(); ++i) {
-      if (i < 3) {  // just populate first three chunks
+    sequencer_.Resize(file_size_);
+    chunks_.Resize(static_cast<uint32_t>(data_map_.chunks.size()), ChunkStatus::remote);
+    // Larger files' chunks are loaded as they're accessed, but while the file is split into three
+    // equal chunks any write rehashes all of them, so they're loaded now.
+    if (file_size_ >= 3 * kMaxChunkSize)
+      return;
+    for (uint32_t i(0); i < 3; ++i) {
+      if (!IsStoredZeroChunk(i)) {  // zero chunks stay as holes in the sequencer
         ByteVector temp(DecryptChunk(i));
-        for (const auto& t : temp)
-          sequencer_[pos++] = t;
+        sequencer_.Write(temp.data(), static_cast<uint32_t>(temp.size()), pos);
+        chunks_.Set(i, ChunkStatus::stored);
       }
+      pos += data_map_.chunks[i].size;
     }
-  } else if (data_map_.content.size() > 0) {
-    for (const auto& t : data_map_.content)
-      sequencer_[pos++] = t;
-    chunks_.insert(std::make_pair(0, ChunkStatus::stored));
   }
 }
 
-SelfEncryptor::~SelfEncryptor() { assert(closed_ && "file not closed"); }
+SelfEncryptor::~SelfEncryptor() {
+  if (finalisation_.valid())
+    finalisation_.wait();
+  assert(closed_ && "file not closed");
+}
 
 bool SelfEncryptor::Write(const char* data, uint32_t length, uint64_t position) {
+  boost::unique_lock<boost::shared_mutex> file_lock(file_mutex_);
   if (closed_)
     BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::encryptor_closed));
   on_scope_exit ose([this] { CleanUpAfterException(); });
   SCOPED_PROFILE
 
+  modified_ = true;
+  ApplyTruncate();
+  const uint64_t kOldSize(file_size_);
   file_size_ = std::max(file_size_, length + position);
-  PrepareWindow(length, position, true);
-  for (uint32_t i(0); i < length; ++i)
-    sequencer_[position + i] = data[i];  // direct as may be overwrite
+  if (file_size_ >= 3 * kMinChunkSize)
+    LeaveSmallFileMode();
+  if (file_size_ != kOldSize)
+    ApplyGrowth(kOldSize);
+  if (small_file_mode_) {
+    if (small_file_content_.size() < position + length)
+      small_file_content_.resize(static_cast<size_t>(position + length));
+    std::copy(data, data + length, small_file_content_.data() + position);
+    ose.Release();
+    return true;
+  }
+  PrepareWindow(length, position);
+  sequencer_.Write(reinterpret_cast<const byte*>(data), length, position);
   ose.Release();
   return true;
 }
 
 bool SelfEncryptor::Read(char* data, uint32_t length, uint64_t position) {
-  if (closed_)
-    BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::encryptor_closed));
-  if ((position + length) > file_size_)
-    return false;  // This is unclear whether to allow the read and fill any unwritten parts with
-                   // zero if reading past EOF. Seems if a file is writtem past EOF then this shoudl
-                   // be OK, this object follows the pattern that a write past EOF is fine, any read
-                   // within that file will work, even on sparse files
-  on_scope_exit ose([this] { CleanUpAfterException(); });
-  SCOPED_PROFILE
-  PrepareWindow(length, position, false);
-  for (uint32_t i(0); i < length; ++i)
-    data[i] = sequencer_[position + i];
-  ose.Release();
-  return true;
+  // Reads share file_mutex_, so only changes left pending by Write or Truncate are applied under
+  // the exclusive lock, after which the read starts over.
+  for (;;) {
+    {
+      boost::shared_lock<boost::shared_mutex> file_lock(file_mutex_);
+      if (closed_ && !readable_after_close_)
+        BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::encryptor_closed));
+      if ((position + length) > file_size_)
+        return false;  // This is unclear whether to allow the read and fill any unwritten parts
+                       // with zero if reading past EOF. Seems if a file is writtem past EOF then
+                       // this shoudl be OK, this object follows the pattern that a write past EOF
+                       // is fine, any read within that file will work, even on sparse files
+      if (closed_) {
+        ReadAfterClose(data, length, position);
+        return true;
+      }
+      if (!ReadNeedsPreparing()) {
+        SCOPED_PROFILE
+        ReadShared(data, length, position);
+        return true;
+      }
+    }
+    boost::unique_lock<boost::shared_mutex> file_lock(file_mutex_);
+    if (closed_ || !ReadNeedsPreparing())
+      continue;
+    on_scope_exit ose([this] { CleanUpAfterException(); });
+    ApplyTruncate();
+    if (file_size_ >= 3 * kMinChunkSize)
+      LeaveSmallFileMode();
+    if (!small_file_mode_ && sequencer_.size() < file_size_)
+      sequencer_.Resize(file_size_);
+    ose.Release();
+  }
 }
 
 bool SelfEncryptor::Truncate(uint64_t position) {
+  boost::unique_lock<boost::shared_mutex> file_lock(file_mutex_);
   if (closed_)
     BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::encryptor_closed));
-  on_scope_exit ose([this] { CleanUpAfterException(); });
   SCOPED_PROFILE
-
-  auto old_size = file_size_;
+  // Only the size changes here.  Growing also invalidates the old last chunks, whose sizes depend
+  // on the file size, so both directions are applied by ApplyTruncate at the next access.
+  modified_ = true;
+  truncated_size_ = std::min(truncated_size_, std::min(file_size_, position));
   file_size_ = position;  //  All helper methods calculate from file size
-  if (position < old_size) {
-    auto it(std::begin(chunks_));
-    while (it != std::end(chunks_))
-      if (it->first > position)
-        it = chunks_.erase(it);
-      else
-        ++it;
-  } else {
-    assert(position - old_size < std::numeric_limits<size_t>::max());
-    PrepareWindow(static_cast<uint32_t>(position - old_size), old_size, true);
-  }
-  ose.Release();
   return true;
 }
 
 bool SelfEncryptor::Flush() {
+  boost::shared_lock<boost::shared_mutex> file_lock(file_mutex_);
   if (closed_)
     BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::encryptor_closed));
   return true;
 }  // noop until we can tell if this is required when asked
 
 void SelfEncryptor::Close() {
-  if (closed_)
-    return;  // can call close multiple times, safely
+  boost::unique_lock<boost::shared_mutex> file_lock(file_mutex_);
+  if (closed_) {
+    // can call close multiple times, safely
+    if (finalisation_.valid())
+      finalisation_.wait();
+    return;
+  }
+  if (!modified_) {
+    // Reads only ever load chunks as stored, so data_map_ still describes the file exactly.
+    closed_ = true;
+    return;
+  }
   on_scope_exit ose([this] { CleanUpAfterException(); });
   SCOPED_PROFILE
 
-  if (file_size_ < (3 * kMinChunkSize)) {
-    data_map_.content.clear();
-    data_map_.content.reserve(file_size_);
-    std::copy_n(std::begin(sequencer_), file_size_, std::back_inserter(data_map_.content));
+  if (!BeginClose())
+    FinishClose();
+  ose.Release();
+  closed_ = true;
+}
+
+std::future<DataMap> SelfEncryptor::CloseAsync() {
+  boost::unique_lock<boost::shared_mutex> file_lock(file_mutex_);
+  auto ready([this] {
+    std::promise<DataMap> promise;
+    promise.set_value(data_map_);
+    return promise.get_future();
+  });
+  if (closed_) {
+    if (finalisation_.valid())
+      finalisation_.wait();
+    return ready();
+  }
+  readable_after_close_ = true;
+  if (!modified_) {
+    closed_ = true;
+    return ready();
+  }
+  {
+    on_scope_exit ose([this] { CleanUpAfterException(); });
+    SCOPED_PROFILE
+    bool finished(BeginClose());
     ose.Release();
     closed_ = true;
-    return;
+    if (finished)
+      return ready();
+  }
+
+  auto promise(std::make_shared<std::promise<DataMap>>());
+  auto result(promise->get_future());
+  finalisation_ = std::async(std::launch::async, [this, promise] {
+    try {
+      on_scope_exit ose([this] {
+        std::lock_guard<std::mutex> gate(rollback_gate_);
+        boost::unique_lock<boost::shared_mutex> rollback_lock(rollback_mutex_);
+        CleanUpAfterException();
+      });
+      FinishClose();
+      ose.Release();
+      std::lock_guard<std::mutex> guard(data_mutex_);
+      promise->set_value(data_map_);
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+    }
+  });
+  return result;
+}
+
+// ##############################Private######################
+
+bool SelfEncryptor::BeginClose() {
+  ApplyTruncate();
+  if (file_size_ >= 3 * kMinChunkSize)
+    LeaveSmallFileMode();
+  if (small_file_mode_) {
+    small_file_content_.resize(static_cast<size_t>(file_size_));
+    JournalContent();
+    data_map_.chunks.clear();
+    data_map_.content = std::move(small_file_content_);
+    return true;
+  }
+  if (file_size_ < (3 * kMinChunkSize)) {
+    JournalChunks(0, undo_journal_.chunk_count);
+    JournalContent();
+    data_map_.chunks.clear();
+    data_map_.content.resize(static_cast<size_t>(file_size_));
+    sequencer_.Read(data_map_.content.data(), static_cast<uint32_t>(file_size_), 0);
+    return true;
   }
   assert(GetNumChunks() > 2 && "Try to close with less than 3 chunks");
-  data_map_.chunks.resize(GetNumChunks());
+  // chunks never touched since the file was opened (e.g. gaps left by writing at an offset)
+  for (uint32_t i(0); i < GetNumChunks(); ++i)
+    chunks_.Insert(i, ChunkStatus::to_be_hashed);
+  ReencryptSuccessors();
+  if (data_map_.chunks.size() != GetNumChunks()) {
+    JournalChunks(GetNumChunks(), undo_journal_.chunk_count);
+    data_map_.chunks.resize(GetNumChunks());
+    ResetPadIvKeys();  // the first two chunks' keys come from the last two chunks
+  }
+  return false;
+}
+
+void SelfEncryptor::FinishClose() {
   std::vector<std::future<void>> fut;
-  for (auto& chunk : chunks_) {
-    if (chunk.second == ChunkStatus::to_be_hashed ||
-        data_map_.chunks[chunk.first].pre_hash.empty() || GetNumChunks() == 3) {
-      auto this_size(GetChunkSize(chunk.first));
-      auto pos = GetStartEndPositions(chunk.first);
+  for (uint32_t chunk(0); chunk < chunks_.size(); ++chunk) {
+    auto status(chunks_.Get(chunk));
+    if (status == ChunkStatus::absent)
+      continue;
+    if (status == ChunkStatus::to_be_hashed || data_map_.chunks[chunk].pre_hash.empty() ||
+        GetNumChunks() == 3) {
+      auto this_size(GetChunkSize(chunk));
+      auto pos = GetStartEndPositions(chunk);
+      chunks_.Set(chunk, ChunkStatus::to_be_encrypted);
+      JournalChunks(chunk, chunk + 1);
+      if (sequencer_.IsHole(pos.first, this_size)) {
+        std::lock_guard<std::mutex> guard(data_mutex_);
+        data_map_.chunks[chunk].pre_hash = ZeroPreHash();
+        continue;
+      }
 
       fut.emplace_back(std::async([=]() {
         ByteVector tmp(this_size);
-        for (uint32_t i(0); i < this_size; ++i)
-          tmp[i] = sequencer_[i + pos.first];
-        assert(tmp.size() == this_size && "vector diff size from chunk size");
-        {
-          std::lock_guard<std::mutex> guard(data_mutex_);
-          data_map_.chunks[chunk.first].pre_hash.clear();
-          data_map_.chunks[chunk.first].pre_hash.resize(crypto::SHA512::DIGESTSIZE);
-        }
-        ByteVector tmp2(crypto::SHA512::DIGESTSIZE);
-        CryptoPP::SHA512().CalculateDigest(&tmp2.data()[0], &tmp.data()[0],
-                                           crypto::SHA512::DIGESTSIZE);
+        sequencer_.Read(tmp.data(), this_size, pos.first);
+        // The old pre-hash stays in place until the new one replaces it, since reads after
+        // CloseAsync may meanwhile derive the keys of remote chunks from it.
+        ByteVector tmp2;
+        CalculatePreHash(&tmp.data()[0], tmp2);
         {
           std::lock_guard<std::mutex> guard(data_mutex_);
-          std::swap(data_map_.chunks[chunk.first].pre_hash, tmp2);
-          assert(crypto::SHA512::DIGESTSIZE == data_map_.chunks[chunk.first].pre_hash.size() &&
+          std::swap(data_map_.chunks[chunk].pre_hash, tmp2);
+          assert(crypto::SHA512::DIGESTSIZE == data_map_.chunks[chunk].pre_hash.size() &&
                  "Hash size wrong");
         }
       }));
-      chunk.second = ChunkStatus::to_be_encrypted;
     }
   }
   // thread barrier emulation
   for (auto& res : fut)
     res.wait();
+  for (uint32_t chunk(0); chunk < chunks_.size(); ++chunk) {
+    if (chunks_.Get(chunk) == ChunkStatus::to_be_encrypted)
+      InvalidatePadIvKey(chunk);
+  }
   std::vector<std::future<void>> fut2;
-  for (auto& chunk : chunks_) {
-    if (chunk.second == ChunkStatus::to_be_encrypted) {
-      auto this_size(GetChunkSize(chunk.first));
-      auto pos = GetStartEndPositions(chunk.first);
+  ChunkSinkQueue sink_queue(sink_, kSinkOptions_);
+  std::set<uint32_t> stored_zero_chunk_sizes;
+  for (uint32_t chunk(0); chunk < chunks_.size(); ++chunk) {
+    if (chunks_.Transition(chunk, ChunkStatus::to_be_encrypted, ChunkStatus::stored)) {
+      JournalChunks(chunk, chunk + 1);
+      auto this_size(GetChunkSize(chunk));
+      auto pos = GetStartEndPositions(chunk);
+      if (sequencer_.IsHole(pos.first, this_size) && HasZeroPreHashes(chunk)) {
+        auto zero_chunk(GetZeroChunk(this_size));
+        if (stored_zero_chunk_sizes.insert(this_size).second) {
+          sink_queue.Add(EncryptedChunk(
+              std::string(std::begin(zero_chunk->hash), std::end(zero_chunk->hash)),
+              zero_chunk->content));
+        }
+        std::lock_guard<std::mutex> guard(data_mutex_);
+        data_map_.chunks[chunk].hash = zero_chunk->hash;
+        data_map_.chunks[chunk].size = this_size;
+        data_map_.chunks[chunk].storage_state = ChunkDetails::kPending;
+        continue;
+      }
 
-      fut2.emplace_back(std::async([=]() {
+      fut2.emplace_back(std::async([=, &sink_queue]() {
         ByteVector tmp(this_size);
-        for (uint32_t i(0); i < this_size; ++i)
-          tmp[i] = sequencer_[i + pos.first];
-        EncryptChunk(chunk.first, tmp, this_size);
+        sequencer_.Read(tmp.data(), this_size, pos.first);
+        EncryptChunk(chunk, tmp, this_size, sink_queue);
       }));
-      chunk.second = ChunkStatus::stored;
     }
   }
   // thread barrier emulation
   for (auto& res : fut2)
     res.wait();
-  ose.Release();
-  closed_ = true;
+  sink_queue.Flush();
 }
 
-// ##############################Private######################
+void SelfEncryptor::JournalChunks(uint32_t begin, uint32_t end) {
+  for (auto chunk(begin); chunk < std::min(end, undo_journal_.chunk_count); ++chunk) {
+    if (undo_journal_.chunks.count(chunk) == 0)
+      undo_journal_.chunks.emplace(chunk, data_map_.chunks[chunk]);
+  }
+}
+
+void SelfEncryptor::JournalContent() {
+  if (undo_journal_.content_saved)
+    return;
+  undo_journal_.content = data_map_.content;
+  undo_journal_.content_saved = true;
+}
+
+void SelfEncryptor::RollBack() {
+  std::lock_guard<std::mutex> guard(data_mutex_);
+  data_map_.chunks.resize(undo_journal_.chunk_count);
+  for (auto& entry : undo_journal_.chunks)
+    data_map_.chunks[entry.first] = std::move(entry.second);
+  undo_journal_.chunks.clear();
+  if (undo_journal_.content_saved) {
+    data_map_.content = std::move(undo_journal_.content);
+    undo_journal_.content_saved = false;
+  }
+}
+
+void SelfEncryptor::ReencryptSuccessors() {
+  // A chunk's key and pad come from the pre-hashes of its two predecessors, so the two chunks
+  // after any which is rehashed must be re-encrypted too.  Those still remote are loaded while
+  // data_map_ still holds the pre-hashes they were encrypted with.
+  auto needs_hashing([this](uint32_t chunk, ChunkStatus status) {
+    return status == ChunkStatus::to_be_hashed || chunk >= data_map_.chunks.size() ||
+           data_map_.chunks[chunk].pre_hash.empty();
+  });
+  std::set<uint32_t> successors;
+  for (uint32_t chunk(0); chunk < std::min(chunks_.size(), GetNumChunks()); ++chunk) {
+    auto status(chunks_.Get(chunk));
+    if (status != ChunkStatus::absent && needs_hashing(chunk, status)) {
+      successors.insert(GetNextChunkNumber(chunk));
+      successors.insert(GetNextChunkNumber(GetNextChunkNumber(chunk)));
+    }
+  }
+  std::vector<std::pair<uint64_t, std::future<ByteVector>>> fut;
+  for (auto chunk : successors) {
+    if (chunks_.Get(chunk) == ChunkStatus::remote && !IsStoredZeroChunk(chunk))
+      fut.emplace_back(GetStoredStartPosition(chunk),
+                       std::async([=]() { return DecryptChunk(chunk); }));
+  }
+  for (auto& res : fut) {
+    ByteVector tmp(res.second.get());
+    sequencer_.Write(tmp.data(), static_cast<uint32_t>(tmp.size()), res.first);
+  }
+  for (auto chunk : successors)
+    chunks_.Set(chunk, ChunkStatus::to_be_hashed);
+}
+
+void SelfEncryptor::ApplyTruncate() {
+  if (truncated_size_ == std::numeric_limits<uint64_t>::max())
+    return;
+  const uint64_t size(truncated_size_);
+  truncated_size_ = std::numeric_limits<uint64_t>::max();
+  if (small_file_mode_) {
+    if (small_file_content_.size() > size)
+      small_file_content_.resize(static_cast<size_t>(size));
+    return;
+  }
+  // Chunks from a few before the one holding 'size' may change size or content.
+  InvalidateChunksFrom(static_cast<uint32_t>(std::max<uint64_t>(size / kMaxChunkSize, 3) - 3),
+                       size);
+  // drops whole segments past 'size' and zeroes the remainder of the last one
+  sequencer_.Resize(size);
+  sequencer_.Resize(file_size_);
+}
+
+uint32_t SelfEncryptor::AddChunksLoadedByTruncate(std::set<uint32_t>& chunks) const {
+  if (truncated_size_ == std::numeric_limits<uint64_t>::max())
+    return std::numeric_limits<uint32_t>::max();
+  // as ApplyTruncate
+  const uint32_t kFirstInvalid(
+      static_cast<uint32_t>(std::max<uint64_t>(truncated_size_ / kMaxChunkSize, 3) - 3));
+  const auto kStoredCount(std::min(chunks_.size(), static_cast<uint32_t>(data_map_.chunks.size())));
+  for (auto chunk(kFirstInvalid); chunk < kStoredCount; ++chunk) {
+    if (GetStoredStartPosition(chunk) < truncated_size_)
+      chunks.insert(chunk);
+  }
+  return kFirstInvalid;
+}
+
+std::vector<std::string> SelfEncryptor::GetChunksToFetch(uint64_t position, uint32_t length,
+                                                         bool write) const {
+  std::set<uint32_t> chunks;
+  const auto kStoredCount(static_cast<uint32_t>(data_map_.chunks.size()));
+  const uint64_t kSize(std::min(file_size_, truncated_size_));
+  AddChunksLoadedByTruncate(chunks);
+  if (write && position + length > file_size_) {
+    // as ApplyGrowth
+    for (auto chunk(kSize < 3 * kMaxChunkSize ? 0 : NumChunks(kSize) - 2); chunk < kStoredCount;
+         ++chunk) {
+      if (GetStoredStartPosition(chunk) < kSize)
+        chunks.insert(chunk);
+    }
+  }
+  // the window, which may be read ahead by two chunks
+  const uint64_t kNewSize(std::max<uint64_t>(file_size_, write ? position + length : 0));
+  if (kNewSize < 3 * kMaxChunkSize) {
+    for (uint32_t chunk(0); chunk < std::min(kStoredCount, 3U); ++chunk)
+      chunks.insert(chunk);
+  } else {
+    auto first(static_cast<uint32_t>(std::min<uint64_t>(position / kMaxChunkSize, kStoredCount)));
+    auto last(std::min<uint64_t>((position + length) / kMaxChunkSize + 3, kStoredCount));
+    for (auto chunk(first == 0 ? 0 : first - 1); chunk < last; ++chunk)
+      chunks.insert(chunk);
+  }
+  return GetRemoteChunkNames(chunks);
+}
 
-void SelfEncryptor::PrepareWindow(uint32_t length, uint64_t position, bool write) {
-  if (sequencer_.size() < file_size_) {
-    sequencer_.resize(file_size_);
-    assert(sequencer_.size() == file_size_);
+std::vector<std::string> SelfEncryptor::GetChunksToFetchOnClose() const {
+  if (!modified_ || closed_)
+    return std::vector<std::string>();
+  std::set<uint32_t> chunks;
+  const auto kStoredCount(static_cast<uint32_t>(data_map_.chunks.size()));
+  const auto kFirstInvalid(AddChunksLoadedByTruncate(chunks));
+  // as ReencryptSuccessors, where chunks which are absent or whose entries the truncation drops
+  // are to be hashed
+  const uint32_t kChunkCount(GetNumChunks());
+  for (uint32_t chunk(0); chunk < kChunkCount; ++chunk) {
+    auto status(chunks_.Get(chunk));
+    if (chunk >= kStoredCount || chunk >= kFirstInvalid || status == ChunkStatus::absent ||
+        status == ChunkStatus::to_be_hashed) {
+      chunks.insert((chunk + 1) % kChunkCount);
+      chunks.insert((chunk + 2) % kChunkCount);
+    }
+  }
+  return GetRemoteChunkNames(chunks);
+}
+
+std::vector<std::string> SelfEncryptor::GetRemoteChunkNames(
+    const std::set<uint32_t>& chunks) const {
+  std::vector<std::string> names;
+  for (auto chunk : chunks) {
+    if (chunk < data_map_.chunks.size() && chunks_.Get(chunk) == ChunkStatus::remote &&
+        !IsStoredZeroChunk(chunk)) {
+      names.emplace_back(std::begin(data_map_.chunks[chunk].hash),
+                         std::end(data_map_.chunks[chunk].hash));
+    }
+  }
+  return names;
+}
+
+void SelfEncryptor::ApplyGrowth(uint64_t old_size) {
+  // Only the last two chunks' sizes depend on the file size, unless the file was small enough to
+  // be split into three equal chunks.  Everything before them keeps its stored layout, and unless
+  // written to stays remote.
+  if (small_file_mode_)
+    return;
+  InvalidateChunksFrom(old_size < 3 * kMaxChunkSize ? 0 : NumChunks(old_size) - 2, old_size);
+}
+
+void SelfEncryptor::InvalidateChunksFrom(uint32_t first_invalid, uint64_t size) {
+  // The dropped entries are rehashed on Close.  Any of those still remote hold the only copy of
+  // their data, so first load the part of it before 'size'.
+  if (sequencer_.size() < data_map_.size())
+    sequencer_.Resize(data_map_.size());
+  std::vector<std::pair<uint64_t, std::future<ByteVector>>> fut;
+  for (auto chunk(first_invalid); chunk < chunks_.size(); ++chunk) {
+    if (chunks_.Get(chunk) != ChunkStatus::remote || chunk >= data_map_.chunks.size())
+      continue;
+    auto pos(GetStoredStartPosition(chunk));
+    if (pos < size && !IsStoredZeroChunk(chunk))
+      fut.emplace_back(pos, std::async([=]() { return DecryptChunk(chunk); }));
+  }
+  for (auto& res : fut) {
+    ByteVector tmp(res.second.get());
+    sequencer_.Write(tmp.data(), static_cast<uint32_t>(tmp.size()), res.first);
   }
+  chunks_.Resize(std::min(chunks_.size(), first_invalid));
+}
+
+void SelfEncryptor::LeaveSmallFileMode() {
+  if (!small_file_mode_)
+    return;
+  small_file_mode_ = false;
+  sequencer_.Resize(file_size_);
+  if (!small_file_content_.empty()) {
+    sequencer_.Write(small_file_content_.data(),
+                     static_cast<uint32_t>(small_file_content_.size()), 0);
+  }
+  ByteVector().swap(small_file_content_);
+}
+
+void SelfEncryptor::PrepareWindow(uint32_t length, uint64_t position) {
+  if (sequencer_.size() < file_size_)
+    sequencer_.Resize(file_size_);
   if (file_size_ < (3 * kMinChunkSize))
     return;
   auto first_chunk(GetChunkNumber(position));
   auto last_chunk(GetChunkNumber(position + length));
-  if (write && (sequencer_.size() < (position + length))) {
-    sequencer_.resize(position + length);
-    assert(sequencer_.size() == (position + length) && "could not resize sequencer");
-  }
+  if (sequencer_.size() < (position + length))
+    sequencer_.Resize(position + length);
   if (file_size_ < 3 * kMaxChunkSize) {
     first_chunk = 0;  // in this case encrypt all.
     last_chunk = 3;
-    chunks_.clear();  // make sure to mark all correctly
+    chunks_.Resize(0);  // make sure to mark all correctly
   } else {            // do not read ahead unless possible
     for (auto i(1); i < 3; ++i)
       if (last_chunk < GetNumChunks())
         ++last_chunk;
   }
 
-  std::vector<std::future<void>> fut2;
+  // Grown before any chunk is loaded, as growing the table mustn't race with the loading tasks.
+  if (chunks_.size() < last_chunk)
+    chunks_.Resize(last_chunk);
+  std::vector<std::future<void>> fut;
+  for (auto i(first_chunk); i < last_chunk; ++i) {
+    if (chunks_.Get(i) == ChunkStatus::remote)
+      fut.emplace_back(std::async([=]() { LoadChunk(i, ChunkStatus::to_be_hashed); }));
+    else
+      chunks_.Set(i, ChunkStatus::to_be_hashed);
+  }
+  for (auto& res : fut)
+    res.get();
+}
+
+bool SelfEncryptor::ReadNeedsPreparing() const {
+  return truncated_size_ != std::numeric_limits<uint64_t>::max() ||
+         (small_file_mode_ ? file_size_ >= 3 * kMinChunkSize : sequencer_.size() < file_size_);
+}
+
+void SelfEncryptor::ReadShared(char* data, uint32_t length, uint64_t position) {
+  if (small_file_mode_) {
+    uint32_t copied(0);
+    if (position < small_file_content_.size()) {
+      copied = static_cast<uint32_t>(
+          std::min<uint64_t>(length, small_file_content_.size() - position));
+      std::copy_n(small_file_content_.data() + position, copied, data);
+    }
+    std::fill(data + copied, data + length, 0);
+    return;
+  }
+  ScatterRead(data, length, position);
+}
+
+void SelfEncryptor::LoadWindow(uint32_t length, uint64_t position, bool read_ahead) {
+  // The whole of a smaller file is loaded by opening it, or by the truncation which shrank it.
+  if (file_size_ < 3 * kMaxChunkSize)
+    return;
+  auto first_chunk(GetChunkNumber(position));
+  uint32_t last_chunk(0);
+  if (read_ahead) {
+    last_chunk = GetChunkNumber(position + length);
+    for (auto i(1); i < 3; ++i)
+      if (last_chunk < GetNumChunks())
+        ++last_chunk;
+  } else if (length != 0) {
+    last_chunk = std::min(GetChunkNumber(position + length - 1) + 1, GetNumChunks());
+  }
+  std::vector<std::future<void>> fut;
   for (auto i(first_chunk); i < last_chunk; ++i) {
-    auto current_chunk_itr = chunks_.find(i);
-    if (current_chunk_itr == std::end(chunks_)) {
-      write ? chunks_.insert({i, ChunkStatus::to_be_hashed}) :
-              chunks_.insert({i, ChunkStatus::stored});
+    if (chunks_.Get(i) == ChunkStatus::remote)
+      fut.emplace_back(std::async([=]() { LoadChunk(i, ChunkStatus::stored); }));
+  }
+  for (auto& res : fut)
+    res.get();
+}
+
+void SelfEncryptor::LoadChunk(uint32_t chunk, ChunkStatus loaded_status) {
+  std::lock_guard<std::mutex> chunk_lock(chunk_mutexes_[chunk % chunk_mutexes_.size()]);
+  if (chunks_.Get(chunk) != ChunkStatus::remote)
+    return;  // loaded by another reader while this one waited
+  if (!IsStoredZeroChunk(chunk)) {  // zero chunks stay as holes in the sequencer
+    ByteVector plain(DecryptChunk(chunk));
+    boost::unique_lock<boost::shared_mutex> sequencer_lock(sequencer_mutex_);
+    sequencer_.Write(plain.data(), static_cast<uint32_t>(plain.size()),
+                     GetStoredStartPosition(chunk));
+  }
+  chunks_.Set(chunk, loaded_status);
+}
+
+void SelfEncryptor::ReadSequencer(char* data, uint32_t length, uint64_t position) const {
+  boost::shared_lock<boost::shared_mutex> sequencer_lock(sequencer_mutex_);
+  sequencer_.Read(reinterpret_cast<byte*>(data), length, position);
+}
+
+void SelfEncryptor::ReadAfterClose(char* data, uint32_t length, uint64_t position) {
+  SCOPED_PROFILE
+  std::unique_lock<std::mutex> gate(rollback_gate_);
+  boost::shared_lock<boost::shared_mutex> rollback_lock(rollback_mutex_);
+  gate.unlock();
+  if (data_map_.chunks.empty()) {
+    std::copy_n(data_map_.content.data() + position, length, data);
+    return;
+  }
+  if (file_size_ < 3 * kMaxChunkSize) {
+    // all three chunks were loaded on opening or are holes
+    sequencer_.Read(reinterpret_cast<byte*>(data), length, position);
+    return;
+  }
+  // Chunks still remote keep their entries, and those of their two predecessors, through
+  // FinishClose; all others are in sequencer_, which FinishClose only reads.
+  const uint64_t kEnd(position + length);
+  for (auto chunk(std::min(GetChunkNumber(position), GetNumChunks() - 1)); chunk < GetNumChunks();
+       ++chunk) {
+    auto start_end(GetStartEndPositions(chunk));
+    if (start_end.first >= kEnd)
+      break;
+    auto begin(std::max(start_end.first, position)), end(std::min(start_end.second, kEnd));
+    if (begin >= end)
+      continue;
+    byte* target(reinterpret_cast<byte*>(data + (begin - position)));
+    if (chunks_.Get(chunk) != ChunkStatus::remote) {
+      sequencer_.Read(target, static_cast<uint32_t>(end - begin), begin);
+    } else if (IsStoredZeroChunk(chunk)) {
+      std::fill(target, target + (end - begin), 0);
+    } else if (begin == start_end.first && end == start_end.second) {
+      DecryptChunk(chunk, target);
     } else {
-      auto pos(GetStartEndPositions(i).first);
-      if (current_chunk_itr->second == ChunkStatus::remote) {
-        fut2.emplace_back(std::async([=]() {
-          auto ins = pos;
-          ByteVector tmp(DecryptChunk(i));
-          for (const auto& t : tmp)
-            sequencer_[ins++] = t;
-        }));
-        write ? current_chunk_itr->second = ChunkStatus::to_be_hashed : current_chunk_itr->second =
-                                                                            ChunkStatus::stored;
-      } else {
-        current_chunk_itr->second = ChunkStatus::to_be_hashed;
-      }
+      ByteVector plain(DecryptChunk(chunk));
+      std::copy(plain.data() + (begin - start_end.first), plain.data() + (end - start_end.first),
+                target);
     }
   }
-  // thread barrier emulation
-  for (auto& res : fut2)
-    res.wait();
+}
+
+void SelfEncryptor::ScatterRead(char* data, uint32_t length, uint64_t position) {
+  auto scatter_chunks(GetScatterReadChunks(length, position));
+  if (scatter_chunks.size() < kMinScatterReadChunks) {
+    LoadWindow(length, position, true);
+    ReadSequencer(data, length, position);
+    return;
+  }
+
+  // The gaps between the scattered chunks go through the sequencer.  Only the last reads ahead,
+  // since the chunks after the others are scattered chunks, which mustn't be decrypted twice.
+  auto read_gap([&](uint64_t begin, uint64_t end, bool read_ahead) {
+    if (begin >= end)
+      return;
+    auto gap_length(static_cast<uint32_t>(end - begin));
+    LoadWindow(gap_length, begin, read_ahead);
+    ReadSequencer(data + (begin - position), gap_length, begin);
+  });
+  uint64_t next(position);
+  for (auto chunk : scatter_chunks) {
+    auto start_end(GetStartEndPositions(chunk));
+    read_gap(next, start_end.first, false);
+    next = start_end.second;
+  }
+  read_gap(next, position + length, true);
+
+  ForEachInParallel(scatter_chunks.size(), [&](size_t i) {
+    auto chunk(scatter_chunks[i]);
+    byte* target(reinterpret_cast<byte*>(data + (GetStartEndPositions(chunk).first - position)));
+    if (IsStoredZeroChunk(chunk))
+      std::fill(target, target + data_map_.chunks[chunk].size, 0);
+    else
+      DecryptChunk(chunk, target);
+  });
+}
+
+std::vector<uint32_t> SelfEncryptor::GetScatterReadChunks(uint32_t length,
+                                                          uint64_t position) const {
+  std::vector<uint32_t> scatter_chunks;
+  if (file_size_ < (3 * kMinChunkSize) || data_map_.chunks.empty())
+    return scatter_chunks;
+  auto chunk_count(std::min(GetNumChunks(), static_cast<uint32_t>(data_map_.chunks.size())));
+  for (auto chunk(GetChunkNumber(position)); chunk < chunk_count; ++chunk) {
+    auto start_end(GetStartEndPositions(chunk));
+    if (start_end.second > position + length)
+      break;
+    if (start_end.first >= position && chunks_.Get(chunk) == ChunkStatus::remote &&
+        data_map_.chunks[chunk].size == start_end.second - start_end.first &&
+        GetStoredStartPosition(chunk) == start_end.first) {
+      scatter_chunks.push_back(chunk);
+    }
+  }
+  return scatter_chunks;
 }
 
 ByteVector SelfEncryptor::DecryptChunk(uint32_t chunk_num) {
+  if (data_map_.chunks.size() < chunk_num) {
+    LOG(kWarning) << "Can't decrypt chunk " << chunk_num << " of " << data_map_.chunks.size();
+    BOOST_THROW_EXCEPTION(MakeError(EncryptErrors::failed_to_decrypt));
+  }
+  ByteVector data(data_map_.chunks[chunk_num].size);
+  DecryptChunk(chunk_num, &data.data()[0]);
+  return data;
+}
+
+void SelfEncryptor::DecryptChunk(uint32_t chunk_num, byte* data) {
   SCOPED_PROFILE
   if (data_map_.chunks.size() < chunk_num) {
     LOG(kWarning) << "Can't decrypt chunk " << chunk_num << " of " << data_map_.chunks.size();
@@ -285,89 +798,74 @@ ByteVector SelfEncryptor::DecryptChunk(uint32_t chunk_num) {
   }
 
   uint32_t length = data_map_.chunks[chunk_num].size;
-  ByteVector data(length);
-  ByteVector pad(kPadSize);
-  ByteVector key(crypto::AES256_KeySize);
-  ByteVector iv(crypto::AES256_IVSize);
-  GetPadIvKey(chunk_num, key, iv, pad);
-  assert(pad.size() == kPadSize && "pad size incorrect");
-  assert(key.size() == crypto::AES256_KeySize && "key size incorrect");
-  assert(iv.size() == crypto::AES256_IVSize && "iv size incorrect");
+  auto keys(GetPadIvKey(chunk_num));
   NonEmptyString content;
   try {
+    PhaseTimer timer(Phase::kFetch, 0);
     content = get_from_store_(std::string(std::begin(data_map_.chunks[chunk_num].hash),
                                           std::end(data_map_.chunks[chunk_num].hash)));
+    timer.set_bytes_out(content.size());
   } catch (const std::exception& e) {
     LOG(kInfo) << boost::diagnostic_information(e);
     throw;
   }
-  // asserts on vector sizes
-  CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryptor(&key.data()[0], crypto::AES256_KeySize,
-                                                          &iv.data()[0]);
-  CryptoPP::ArraySource filter(
-      content.data(), content.size(), true,
-      new XORFilter(new CryptoPP::StreamTransformationFilter(
-                        decryptor, new CryptoPP::Gunzip(new CryptoPP::MessageQueue)),
-                    &pad.data()[0]));
-  filter.Get(&data.data()[0], length);
-  auto chunk_itr(chunks_.find(chunk_num));
-  assert(chunk_itr != std::end(chunks_) && "chunks status not found");
-  chunk_itr->second = ChunkStatus::stored;
-
-  return data;
+  DecryptContent(content, *keys, data, length);
 }
 
-void SelfEncryptor::GetPadIvKey(uint32_t chunk_number, ByteVector& key, ByteVector& iv,
-                                ByteVector& pad) {
+std::shared_ptr<const ChunkKeys> SelfEncryptor::GetPadIvKey(uint32_t chunk_number) {
   SCOPED_PROFILE
-  assert(pad.size() == kPadSize && "pad size incorrect");
-  assert(key.size() == crypto::AES256_KeySize && "key size incorrect");
-  assert(iv.size() == crypto::AES256_IVSize && "iv size incorrect");
+  std::lock_guard<std::mutex> guard(data_mutex_);
+  // neighbours are taken from data_map_, which until Close may not match the current file size
+  auto chunk_count(static_cast<uint32_t>(data_map_.chunks.size()));
+  assert(chunk_number < chunk_count && "chunk not in data map");
+  assert(chunk_keys_.size() == chunk_count && "key cache out of step with data map");
+  auto& keys(chunk_keys_[chunk_number]);
+  if (!keys) {
+    uint32_t n_1_chunk((chunk_count + chunk_number - 1) % chunk_count);
+    uint32_t n_2_chunk((chunk_count + chunk_number - 2) % chunk_count);
+    std::shared_ptr<ChunkKeys> derived(std::make_shared<ChunkKeys>());
+    DerivePadIvKey(data_map_.chunks[chunk_number].pre_hash, data_map_.chunks[n_1_chunk].pre_hash,
+                   data_map_.chunks[n_2_chunk].pre_hash, *derived);
+    keys = std::move(derived);
+  }
+  return keys;
+}
+
+void SelfEncryptor::InvalidatePadIvKey(uint32_t chunk_number) {
+  std::lock_guard<std::mutex> guard(data_mutex_);
+  auto chunk_count(static_cast<uint32_t>(chunk_keys_.size()));
+  for (uint32_t i(0); i < std::min(chunk_count, 3U); ++i)
+    chunk_keys_[(chunk_number + i) % chunk_count].reset();
+}
+
+void SelfEncryptor::ResetPadIvKeys() {
+  std::lock_guard<std::mutex> guard(data_mutex_);
+  chunk_keys_.clear();
+  chunk_keys_.resize(data_map_.chunks.size());
+}
+
+bool SelfEncryptor::HasZeroPreHashes(uint32_t chunk_number) const {
   uint32_t n_1_chunk(GetPreviousChunkNumber(chunk_number));
   uint32_t n_2_chunk(GetPreviousChunkNumber(n_1_chunk));
-#ifndef NDEBUG
-  auto chunk_n_1_itr(chunks_.find(n_1_chunk));
-  auto chunk_n_2_itr(chunks_.find(n_2_chunk));
-#endif
-  assert(chunks_.size() >= n_1_chunk);
-  assert(chunks_.size() >= n_2_chunk);
-  assert(chunk_n_1_itr != std::end(chunks_) && "chunk_n_1 chunkstatus not found");
-  assert(chunk_n_2_itr != std::end(chunks_) && "chunk_n_2 chunkstatus not found");
-
-  const ByteVector n_1_pre_hash{data_map_.chunks[n_1_chunk].pre_hash};
-  const ByteVector n_2_pre_hash{data_map_.chunks[n_2_chunk].pre_hash};
-
-  assert(n_1_pre_hash.size() == crypto::SHA512::DIGESTSIZE);
-  assert(n_2_pre_hash.size() == crypto::SHA512::DIGESTSIZE);
-  key.clear();
-  // cannot use copy_n as there is an apparent bug in MSVC 2013 :-(
-  std::copy(std::begin(n_2_pre_hash), std::begin(n_2_pre_hash) + crypto::AES256_KeySize,
-            std::back_inserter(key));
-  iv.clear();
-  std::copy(std::begin(n_2_pre_hash) + crypto::AES256_KeySize,
-            std::begin(n_2_pre_hash) + crypto::AES256_KeySize + crypto::AES256_IVSize,
-            std::back_inserter(iv));
-  // pad
-  assert(kPadSize ==
-             (2 * crypto::SHA512::DIGESTSIZE) + crypto::SHA512::DIGESTSIZE -
-                 crypto::AES256_KeySize - crypto::AES256_IVSize &&
-         "pad size wrong");
-  pad.clear();
-  std::copy_n(std::begin(n_1_pre_hash), crypto::SHA512::DIGESTSIZE, std::back_inserter(pad));
-  std::copy_n(std::begin(data_map_.chunks[chunk_number].pre_hash), crypto::SHA512::DIGESTSIZE,
-              std::back_inserter(pad));  // + crypto::SHA512::DIGESTSIZE);
-  std::copy_n(std::begin(n_2_pre_hash) + crypto::AES256_KeySize + crypto::AES256_IVSize,
-              crypto::SHA512::DIGESTSIZE - crypto::AES256_KeySize - crypto::AES256_IVSize,
-              std::back_inserter(pad));  // + crypto::SHA512::DIGESTSIZE * 2);
-  assert(pad.size() == kPadSize && "pad size incorrect");
-  assert(key.size() == crypto::AES256_KeySize && "key size incorrect");
-  assert(iv.size() == crypto::AES256_IVSize && "iv size incorrect");
-}
-
-void SelfEncryptor::EncryptChunk(uint32_t chunk_number, ByteVector data, uint32_t length) {
+  if (std::max(std::max(chunk_number, n_1_chunk), n_2_chunk) >= data_map_.chunks.size())
+    return false;
+  return data_map_.chunks[chunk_number].pre_hash == ZeroPreHash() &&
+         data_map_.chunks[n_1_chunk].pre_hash == ZeroPreHash() &&
+         data_map_.chunks[n_2_chunk].pre_hash == ZeroPreHash();
+}
+
+bool SelfEncryptor::IsStoredZeroChunk(uint32_t chunk_number) const {
+  // chunks are content-addressed, so a matching name means a matching chunk
+  if (chunk_number >= data_map_.chunks.size())
+    return false;
+  const auto& chunk(data_map_.chunks[chunk_number]);
+  return chunk.pre_hash == ZeroPreHash() && chunk.hash == GetZeroChunk(chunk.size)->hash;
+}
+
+void SelfEncryptor::EncryptChunk(uint32_t chunk_number, const ByteVector& data, uint32_t length,
+                                 ChunkSinkQueue& sink_queue) {
   SCOPED_PROFILE
-  auto chunk_n_itr(chunks_.find(chunk_number));
-  assert(chunk_n_itr != std::end(chunks_) && "this chunk chunkstatus not found");
+  assert(chunks_.Get(chunk_number) != ChunkStatus::absent && "this chunk chunkstatus not found");
 #ifndef NDEBUG
   {
     std::lock_guard<std::mutex> guard(data_mutex_);
@@ -375,45 +873,22 @@ void SelfEncryptor::EncryptChunk(uint32_t chunk_number, ByteVector data, uint32_
     assert(chunks_.size() >= chunk_number);
     uint32_t n_1_chunk(GetPreviousChunkNumber(chunk_number));
     uint32_t n_2_chunk(GetPreviousChunkNumber(n_1_chunk));
-    auto chunk_n_1_itr(chunks_.find(n_1_chunk));
-    auto chunk_n_2_itr(chunks_.find(n_2_chunk));
-
-    assert(chunk_n_1_itr->second != ChunkStatus::to_be_hashed && "chunk_n_1 hash invalid");
-    assert(chunk_n_2_itr->second != ChunkStatus::to_be_hashed && "chunk_n_2 hash invalid");
+    assert(chunks_.Get(n_1_chunk) != ChunkStatus::to_be_hashed && "chunk_n_1 hash invalid");
+    assert(chunks_.Get(n_2_chunk) != ChunkStatus::to_be_hashed && "chunk_n_2 hash invalid");
   }
 #endif
 
-  ByteVector pad(kPadSize);
-  ByteVector key(crypto::AES256_KeySize);
-  ByteVector iv(crypto::AES256_IVSize);
-  GetPadIvKey(chunk_number, key, iv, pad);
-  assert(pad.size() == kPadSize && "pad size incorrect");
-  assert(key.size() == crypto::AES256_KeySize && "key size incorrect");
-  assert(iv.size() == crypto::AES256_IVSize && "iv size incorrect");
-
-  CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryptor(&key.data()[0], crypto::AES256_KeySize,
-                                                          &iv.data()[0]);
-
   std::string chunk_content;
-  chunk_content.reserve(length);
-  CryptoPP::Gzip aes_filter(
-      new CryptoPP::StreamTransformationFilter(
-          encryptor, new XORFilter(new CryptoPP::StringSink(chunk_content), &pad.data()[0])),
-      1);
-  aes_filter.Put2(&data.data()[0], length, -1, true);
-
-  CryptoPP::SHA512 hash;
-  std::string result;
-  CryptoPP::StringSource(chunk_content, true,
-                         new CryptoPP::HashFilter(hash, new CryptoPP::StringSink(result)));
-
-  buffer_.Store(DataBuffer::KeyType(Identity(result), DataTypeId(0)),
-                NonEmptyString(chunk_content));
+  std::string result(EncryptContent(&data.data()[0], length, *GetPadIvKey(chunk_number),
+                                    chunk_content));
+
+  sink_queue.Add(EncryptedChunk(result, std::move(chunk_content)));
   {
     std::lock_guard<std::mutex> guard(data_mutex_);
+    RecordChunkEncrypted(!data_map_.chunks[chunk_number].hash.empty());
     ByteVector tmp2(std::begin(result), std::end(result));
     std::swap(data_map_.chunks[chunk_number].hash, tmp2);
-    chunk_n_itr->second = ChunkStatus::stored;
+    chunks_.Set(chunk_number, ChunkStatus::stored);
     assert(crypto::SHA512::DIGESTSIZE == data_map_.chunks[chunk_number].hash.size() &&
            "Hash size wrong");
 
@@ -425,65 +900,28 @@ void SelfEncryptor::EncryptChunk(uint32_t chunk_number, ByteVector data, uint32_
 // ####################Helpers############################
 
 uint32_t SelfEncryptor::GetChunkSize(uint32_t chunk) const {
-  if (file_size_ < 3 * kMinChunkSize)
-    return 0;
-  assert(GetNumChunks() != 0 && "file size has no chunks");
-  if (file_size_ < 3 * kMaxChunkSize) {
-    if (chunk < 2)
-      return static_cast<uint32_t>(file_size_ / 3);
-    else
-      return static_cast<uint32_t>(file_size_ - (2 * (file_size_ / 3)));
-  }
-  // handle all but last 2 chunks
-  if (chunk < GetNumChunks() - 2)
-    return kMaxChunkSize;
-
-  uint32_t remainder(static_cast<uint32_t>(file_size_ % kMaxChunkSize));
-  bool penultimate((GetNumChunks() - 2) == chunk);
-
-  if (remainder == 0)
-    return kMaxChunkSize;
-  // if the last chunk is goind to be less than kMinChunkSize we reduce the penultimate chunk by
-  // kMinChunkSize
-  if (remainder < kMinChunkSize) {
-    if (penultimate)
-      return kMaxChunkSize - kMinChunkSize;
-    else
-      return kMinChunkSize + remainder;
-  } else {
-    if (penultimate)
-      return kMaxChunkSize;
-    else
-      return remainder;
-  }
+  assert((file_size_ < 3 * kMinChunkSize || GetNumChunks() != 0) && "file size has no chunks");
+  return ChunkSize(file_size_, chunk);
 }
 
-uint32_t SelfEncryptor::GetNumChunks() const {
-  if (file_size_ < 3 * kMinChunkSize)
-    return 0;
-  if (file_size_ < 3 * kMaxChunkSize)
-    return 3;
-  if (static_cast<uint32_t>(file_size_ % kMaxChunkSize == 0))
-    return static_cast<uint32_t>(file_size_ / kMaxChunkSize);
-  else
-    return static_cast<uint32_t>(file_size_ / kMaxChunkSize) + 1;
-}
+uint32_t SelfEncryptor::GetNumChunks() const { return NumChunks(file_size_); }
 
 std::pair<uint64_t, uint64_t> SelfEncryptor::GetStartEndPositions(uint32_t chunk_number) const {
   assert(GetNumChunks() > 2 && "less than 3 chunks");
   if (GetNumChunks() == 0)
     return {0, 0};
-  auto start(0);
+  uint64_t start(0);
+  uint64_t chunk_size(GetChunkSize(0));
   bool penultimate((GetNumChunks() - 2) == chunk_number);
   bool last((GetNumChunks() - 1) == chunk_number);
 
   if (last) {
-    start = ((GetChunkSize(0) * (chunk_number - 2)) + GetChunkSize(chunk_number - 2) +
+    start = ((chunk_size * (chunk_number - 2)) + GetChunkSize(chunk_number - 2) +
              GetChunkSize(chunk_number - 1));
   } else if (penultimate) {
-    start = ((GetChunkSize(0) * (chunk_number - 1)) + GetChunkSize(chunk_number - 1));
+    start = ((chunk_size * (chunk_number - 1)) + GetChunkSize(chunk_number - 1));
   } else {
-    start = (GetChunkSize(0) * (chunk_number));
+    start = (chunk_size * (chunk_number));
   }
 
   return std::make_pair(start, start + GetChunkSize(chunk_number));
@@ -501,6 +939,16 @@ uint32_t SelfEncryptor::GetPreviousChunkNumber(uint32_t chunk_number) const {
   return (GetNumChunks() + chunk_number - 1) % GetNumChunks();
 }
 
+uint64_t SelfEncryptor::GetStoredStartPosition(uint32_t chunk_number) const {
+  // all but the last chunk start at a multiple of the first chunk's size
+  auto chunk_count(static_cast<uint32_t>(data_map_.chunks.size()));
+  assert(chunk_number < chunk_count && "chunk not in data map");
+  uint64_t chunk_size(data_map_.chunks[0].size);
+  if (chunk_number + 1 < chunk_count)
+    return chunk_size * chunk_number;
+  return chunk_size * (chunk_number - 1) + data_map_.chunks[chunk_number - 1].size;
+}
+
 uint32_t SelfEncryptor::GetChunkNumber(uint64_t position) const {
   if (GetNumChunks() == 0) {
     return 0;
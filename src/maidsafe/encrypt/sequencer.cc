@@ -0,0 +1,120 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/sequencer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "maidsafe/common/config.h"
+
+#include "maidsafe/encrypt/metrics_recorder.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+// Segments are chunk-sized, or a whole number of chunks spanning a huge page when huge pages are
+// enabled (smaller allocations would silently fall back to standard pages).
+uint32_t SegmentSize() {
+  if (GetPagePolicy() == PagePolicy::kStandard || HugePageSize() <= kMaxChunkSize)
+    return kMaxChunkSize;
+  return static_cast<uint32_t>(((HugePageSize() + kMaxChunkSize - 1) / kMaxChunkSize) *
+                               kMaxChunkSize);
+}
+
+bool IsZero(const byte* data, uint32_t length) {
+  return std::all_of(data, data + length, [](byte b) { return b == 0; });
+}
+
+}  // unnamed namespace
+
+Sequencer::Sequencer() : kSegmentSize_(SegmentSize()), segments_(), size_(0) {}
+
+Sequencer::~Sequencer() { Resize(0); }
+
+void Sequencer::Resize(uint64_t size) {
+  auto segment_count(static_cast<size_t>((size + kSegmentSize_ - 1) / kSegmentSize_));
+  int64_t released(0);
+  for (auto i(segment_count); i < segments_.size(); ++i)
+    released += segments_[i].size();
+  if (released != 0)
+    RecordSequencerBytes(-released);
+  segments_.resize(segment_count);
+  if (size < size_) {
+    // zero the tail of the last kept segment so a later grow reads back '\0's
+    auto tail(static_cast<uint32_t>(size % kSegmentSize_));
+    if (tail != 0 && !segments_.back().empty())
+      std::fill(std::begin(segments_.back()) + tail, std::end(segments_.back()), 0);
+  }
+  size_ = size;
+}
+
+void Sequencer::Write(const byte* data, uint32_t length, uint64_t position) {
+  assert(position + length <= size_ && "write past end of sequencer");
+  while (length != 0) {
+    auto& segment(segments_[static_cast<size_t>(position / kSegmentSize_)]);
+    auto offset(static_cast<uint32_t>(position % kSegmentSize_));
+    auto count(std::min(length, kSegmentSize_ - offset));
+    if (segment.empty() && !IsZero(data, count)) {
+      segment.resize(kSegmentSize_);
+      RecordSequencerBytes(kSegmentSize_);
+    }
+    if (!segment.empty())
+      std::memcpy(&segment[offset], data, count);
+    data += count;
+    length -= count;
+    position += count;
+  }
+}
+
+void Sequencer::Read(byte* data, uint32_t length, uint64_t position) const {
+  assert(position + length <= size_ && "read past end of sequencer");
+  while (length != 0) {
+    const auto& segment(segments_[static_cast<size_t>(position / kSegmentSize_)]);
+    auto offset(static_cast<uint32_t>(position % kSegmentSize_));
+    auto count(std::min(length, kSegmentSize_ - offset));
+    if (segment.empty())
+      std::memset(data, 0, count);
+    else
+      std::memcpy(data, &segment[offset], count);
+    data += count;
+    length -= count;
+    position += count;
+  }
+}
+
+bool Sequencer::IsHole(uint64_t position, uint64_t length) const {
+  assert(position + length <= size_ && "range past end of sequencer");
+  if (length == 0)
+    return true;
+  auto first(static_cast<size_t>(position / kSegmentSize_));
+  auto last(static_cast<size_t>((position + length - 1) / kSegmentSize_));
+  for (auto i(first); i <= last; ++i) {
+    if (!segments_[i].empty())
+      return false;
+  }
+  return true;
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,299 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/make_unique.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/async_self_encryptor.h"
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+namespace {
+
+// Tasks queue up until the test thread runs them, as on a single-threaded event loop.
+class EventLoop {
+ public:
+  EventLoop() : mutex_(), condition_(), tasks_() {}
+
+  Executor executor() {
+    return [this](std::function<void()> task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+      }
+      condition_.notify_one();
+    };
+  }
+
+  void RunUntil(std::function<bool()> done) {
+    while (!done()) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ASSERT_TRUE(condition_.wait_for(lock, std::chrono::seconds(60),
+                                        [this] { return !tasks_.empty(); }));
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<std::function<void()>> tasks_;
+};
+
+// An in-memory stand-in for a network store, completing each fetch from its own I/O thread.
+class AsyncStore {
+ public:
+  explicit AsyncStore(DataBuffer& buffer)
+      : buffer_(buffer), mutex_(), condition_(), requests_(), stopped_(false), io_thread_() {
+    io_thread_ = std::thread([this] { Serve(); });
+  }
+  ~AsyncStore() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    condition_.notify_one();
+    io_thread_.join();
+  }
+
+  AsyncGetFromStore get_from_store() {
+    return [this](const std::string& name,
+                  std::function<void(std::exception_ptr, NonEmptyString)> on_fetched) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_.emplace_back(name, std::move(on_fetched));
+      }
+      condition_.notify_one();
+    };
+  }
+
+ private:
+  using Request = std::pair<std::string, std::function<void(std::exception_ptr, NonEmptyString)>>;
+
+  void Serve() {
+    for (;;) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return stopped_ || !requests_.empty(); });
+        if (requests_.empty())
+          return;
+        request = std::move(requests_.front());
+        requests_.pop_front();
+      }
+      try {
+        auto content(buffer_.Get(DataBuffer::KeyType(Identity(request.first), DataTypeId(0))));
+        request.second(nullptr, std::move(content));
+      } catch (...) {
+        request.second(std::current_exception(), NonEmptyString());
+      }
+    }
+  }
+
+  DataBuffer& buffer_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<Request> requests_;
+  bool stopped_;
+  std::thread io_thread_;
+};
+
+}  // unnamed namespace
+
+class AsyncSelfEncryptorTest : public EncryptTestBase, public testing::Test {
+ protected:
+  AsyncSelfEncryptorTest() : event_loop_(), store_(local_store_) {}
+
+  virtual void TearDown() override { self_encryptor_->Close(); }
+
+  std::unique_ptr<AsyncSelfEncryptor> Open(DataMap& data_map) {
+    return maidsafe::make_unique<AsyncSelfEncryptor>(data_map, local_store_,
+                                                     store_.get_from_store(),
+                                                     event_loop_.executor());
+  }
+
+  // Runs the event loop until 'count' handlers have been called, expecting each to succeed.
+  void Wait(const int& completed, int count) {
+    event_loop_.RunUntil([&] { return completed == count; });
+  }
+
+  AsyncSelfEncryptor::Handler Expect(int& completed) {
+    return [&completed](std::exception_ptr error) {
+      EXPECT_FALSE(error);
+      ++completed;
+    };
+  }
+
+  std::string ReadWithSelfEncryptor(DataMap& data_map) {
+    SelfEncryptor self_encryptor(data_map, local_store_, get_from_store_);
+    std::string content(static_cast<size_t>(data_map.size()), 0);
+    EXPECT_TRUE(self_encryptor.Read(&content[0], static_cast<uint32_t>(content.size()), 0));
+    self_encryptor.Close();
+    return content;
+  }
+
+  EventLoop event_loop_;
+  AsyncStore store_;
+};
+
+TEST_F(AsyncSelfEncryptorTest, BEH_WriteReadModifyAndClose) {
+  for (uint32_t size : {100U, 2 * kMaxChunkSize, 6 * kMaxChunkSize + 7}) {
+    DataMap data_map;
+    std::string content(RandomString(size));
+    int completed(0);
+    auto encryptor(Open(data_map));
+    // written in two parts, the second first
+    encryptor->Write(content.substr(size / 2), size / 2, Expect(completed));
+    encryptor->Write(content.substr(0, size / 2), 0, Expect(completed));
+    encryptor->Close(Expect(completed));
+    Wait(completed, 3);
+    EXPECT_EQ(size, data_map.size());
+    EXPECT_TRUE(content == ReadWithSelfEncryptor(data_map)) << size;
+
+    encryptor = Open(data_map);
+    completed = 0;
+    std::string read;
+    encryptor->Read(size / 3, size / 3, [&](std::exception_ptr error, std::string data) {
+      EXPECT_FALSE(error);
+      read = std::move(data);
+      ++completed;
+    });
+    const std::string kRewrite(RandomString(50)), kAppended(RandomString(kMaxChunkSize + 9));
+    encryptor->Write(kRewrite, size / 2, Expect(completed));
+    encryptor->Write(kAppended, size, Expect(completed));
+    encryptor->Truncate(size + kMaxChunkSize, Expect(completed));
+    encryptor->Close(Expect(completed));
+    Wait(completed, 5);
+    EXPECT_TRUE(content.substr(size / 3, size / 3) == read) << size;
+    content.replace(size / 2, 50, kRewrite);
+    content += kAppended.substr(0, kMaxChunkSize);
+    EXPECT_TRUE(content == ReadWithSelfEncryptor(data_map)) << size;
+    // every chunk needed was fetched before the call needing it ran
+    EXPECT_EQ(0, encryptor->blocking_fetches()) << size;
+  }
+}
+
+TEST_F(AsyncSelfEncryptorTest, BEH_RepeatedChunksAreFetchedOnce) {
+  // the chunks from 2 on have the same content and predecessors, so share one stored chunk
+  DataMap data_map;
+  std::string content;
+  const std::string kBlock(RandomString(kMaxChunkSize));
+  for (int i(0); i != 6; ++i)
+    content += kBlock;
+  int completed(0);
+  auto encryptor(Open(data_map));
+  encryptor->Write(content, 0, Expect(completed));
+  encryptor->Close(Expect(completed));
+  Wait(completed, 2);
+  ASSERT_EQ(6, data_map.chunks.size());
+  EXPECT_EQ(data_map.chunks[2].hash, data_map.chunks[5].hash);
+
+  encryptor = Open(data_map);
+  completed = 0;
+  std::string read;
+  encryptor->Read(0, static_cast<uint32_t>(content.size()),
+                  [&](std::exception_ptr error, std::string data) {
+                    EXPECT_FALSE(error);
+                    read = std::move(data);
+                    ++completed;
+                  });
+  encryptor->Close(Expect(completed));
+  Wait(completed, 2);
+  EXPECT_TRUE(content == read);
+  EXPECT_EQ(0, encryptor->blocking_fetches());
+}
+
+TEST_F(AsyncSelfEncryptorTest, BEH_ReadPastEndFails) {
+  DataMap data_map;
+  int completed(0);
+  auto encryptor(Open(data_map));
+  encryptor->Write(RandomString(10), 0, Expect(completed));
+  encryptor->Read(5, 10, [&](std::exception_ptr error, std::string data) {
+    EXPECT_TRUE(error);
+    EXPECT_TRUE(data.empty());
+    ++completed;
+  });
+  encryptor->Close(Expect(completed));
+  Wait(completed, 3);
+  EXPECT_EQ(10, data_map.size());
+}
+
+TEST_F(AsyncSelfEncryptorTest, FUNC_ManySessionsOnOneThread) {
+  const size_t kSessionCount(24);
+  const std::vector<uint32_t> kSizes{100, 3 * kMinChunkSize, kMaxChunkSize, 3 * kMaxChunkSize + 1};
+  std::vector<DataMap> data_maps(kSessionCount);
+  std::vector<std::string> contents;
+  std::vector<std::unique_ptr<AsyncSelfEncryptor>> encryptors;
+  int completed(0);
+  for (size_t i(0); i != kSessionCount; ++i) {
+    contents.push_back(RandomString(kSizes[i % kSizes.size()]));
+    encryptors.push_back(Open(data_maps[i]));
+    encryptors.back()->Write(contents.back(), 0, Expect(completed));
+    encryptors.back()->Close(Expect(completed));
+  }
+  Wait(completed, static_cast<int>(2 * kSessionCount));
+
+  // reopen them all and read every file back, the sessions interleaving on the one thread
+  completed = 0;
+  std::vector<std::string> read(kSessionCount);
+  for (size_t i(0); i != kSessionCount; ++i) {
+    encryptors[i] = Open(data_maps[i]);
+    encryptors[i]->Read(0, static_cast<uint32_t>(contents[i].size()),
+                        [&, i](std::exception_ptr error, std::string data) {
+                          EXPECT_FALSE(error);
+                          read[i] = std::move(data);
+                          ++completed;
+                        });
+    encryptors[i]->Close(Expect(completed));
+  }
+  Wait(completed, static_cast<int>(2 * kSessionCount));
+  for (size_t i(0); i != kSessionCount; ++i) {
+    EXPECT_TRUE(contents[i] == read[i]) << i;
+    EXPECT_EQ(0, encryptors[i]->blocking_fetches()) << i;
+  }
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,94 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/make_unique.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/batch_encryptor.h"
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/restore.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+class BatchEncryptorTest : public EncryptTestBase, public testing::Test {
+ protected:
+  virtual void TearDown() override { self_encryptor_->Close(); }
+
+  DataMap EncryptWithSelfEncryptor(const std::string& content) {
+    self_encryptor_->Close();
+    data_map_ = DataMap();
+    self_encryptor_ =
+        maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+    EXPECT_TRUE(self_encryptor_->Write(content.data(), static_cast<uint32_t>(content.size()), 0));
+    self_encryptor_->Close();
+    return data_map_;
+  }
+
+  std::string RestoreFile(const DataMap& data_map) {
+    std::string restored;
+    Restore(data_map, get_from_store_, [&](const char* data, uint32_t length, uint64_t) {
+      restored.append(data, length);
+    });
+    return restored;
+  }
+};
+
+TEST_F(BatchEncryptorTest, BEH_MatchesSelfEncryptor) {
+  std::vector<std::string> contents;
+  for (uint32_t size : {0U, 100U, 3 * kMinChunkSize - 1, 3 * kMinChunkSize, 3 * kMaxChunkSize + 1,
+                        3 * kMaxChunkSize + kMinChunkSize / 2, 5 * kMaxChunkSize + 12345}) {
+    contents.push_back(RandomString(size));
+  }
+  contents.push_back(std::string(4 * kMaxChunkSize, 0));
+  std::vector<BatchFile> files;
+  for (const auto& content : contents)
+    files.emplace_back(content.data(), content.size());
+
+  auto data_maps(EncryptFiles(files, local_store_));
+  ASSERT_EQ(contents.size(), data_maps.size());
+  for (size_t i(0); i != contents.size(); ++i) {
+    EXPECT_EQ(contents[i].size(), data_maps[i].size()) << i;
+    EXPECT_EQ(EncryptWithSelfEncryptor(contents[i]), data_maps[i]) << i;
+    EXPECT_EQ(contents[i], RestoreFile(data_maps[i])) << i;
+  }
+}
+
+TEST_F(BatchEncryptorTest, BEH_EmptyBatchAndInvalidInput) {
+  EXPECT_TRUE(EncryptFiles(std::vector<BatchFile>(), local_store_).empty());
+  std::vector<BatchFile> files(1, BatchFile(nullptr, 10));
+  EXPECT_THROW(EncryptFiles(files, local_store_), common_error);
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
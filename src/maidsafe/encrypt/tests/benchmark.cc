@@ -16,17 +16,85 @@
     See the Licences for the specific language governing permissions and limitations relating to
     use of the MaidSafe Software.                                                                 */
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <memory>
-#include "boost/filesystem/operations.hpp"
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "maidsafe/common/log.h"
 #include "maidsafe/common/make_unique.h"
 #include "maidsafe/common/test.h"
 
+#include "maidsafe/encrypt/page_allocator.h"
 #include "maidsafe/encrypt/tests/encrypt_test_base.h"
 
-namespace fs = boost::filesystem;
+namespace {
+
+// Heap accounting for this executable.  Each allocation is prefixed with its size so that frees
+// can be accounted for too.
+const size_t kAllocationHeaderSize(alignof(std::max_align_t));
+std::atomic<uint64_t> g_allocations(0), g_allocated_bytes(0), g_live_bytes(0),
+    g_peak_live_bytes(0);
+
+void* Allocate(std::size_t size) {
+  char* memory(static_cast<char*>(std::malloc(size + kAllocationHeaderSize)));
+  if (!memory)
+    return nullptr;
+  *reinterpret_cast<std::size_t*>(memory) = size;
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  auto live(g_live_bytes.fetch_add(size, std::memory_order_relaxed) + size);
+  auto peak(g_peak_live_bytes.load(std::memory_order_relaxed));
+  while (live > peak && !g_peak_live_bytes.compare_exchange_weak(peak, live)) {
+  }
+  return memory + kAllocationHeaderSize;
+}
+
+void Deallocate(void* pointer) {
+  if (!pointer)
+    return;
+  char* memory(static_cast<char*>(pointer) - kAllocationHeaderSize);
+  g_live_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(memory), std::memory_order_relaxed);
+  std::free(memory);
+}
+
+}  // unnamed namespace
+
+void* operator new(std::size_t size) {
+  if (void* memory = Allocate(size))
+    return memory;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void operator delete(void* pointer) noexcept { Deallocate(pointer); }
+
+void operator delete[](void* pointer) noexcept { Deallocate(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept { Deallocate(pointer); }
+
+void operator delete[](void* pointer, std::size_t) noexcept { Deallocate(pointer); }
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { Deallocate(pointer); }
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { Deallocate(pointer); }
 
 namespace maidsafe {
 
@@ -34,19 +102,30 @@ namespace encrypt {
 
 namespace test {
 
-class Benchmark : public EncryptTestBase, public testing::TestWithParam<uint32_t> {
+class Benchmark : public EncryptTestBase,
+                  public testing::TestWithParam<std::tuple<uint32_t, PagePolicy>> {
  public:
   typedef std::chrono::time_point<std::chrono::high_resolution_clock> chrono_time_point;
 
   Benchmark()
       : EncryptTestBase(),
         kTestDataSize_(1024 * 1024 * 20),
-        kPieceSize_(GetParam() ? GetParam() : kTestDataSize_) {
+        kPieceSize_(std::get<0>(GetParam()) ? std::get<0>(GetParam()) : kTestDataSize_),
+        kPagePolicy_(std::get<1>(GetParam())) {
     original_.reset(new char[kTestDataSize_]);
     decrypted_.reset(new char[kTestDataSize_]);
   }
 
  protected:
+  virtual void SetUp() override {
+    // The fixture's encryptor was built under the previous policy, so replace it.
+    SetPagePolicy(kPagePolicy_);
+    self_encryptor_->Close();
+    self_encryptor_ =
+        maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  }
+  virtual void TearDown() override { SetPagePolicy(PagePolicy::kStandard); }
+
   void PrintResult(const chrono_time_point& start_time, const chrono_time_point& stop_time,
                    bool encrypting, bool compressible) {
     uint64_t duration =
@@ -56,9 +135,14 @@ class Benchmark : public EncryptTestBase, public testing::TestWithParam<uint32_t
     uint64_t rate((static_cast<uint64_t>(kTestDataSize_) * 1000000) / duration);
     std::string encrypted(encrypting ? "Self-encrypted " : "Self-decrypted ");
     std::string comp(compressible ? "compressible" : "incompressible");
+    std::string pages(kPagePolicy_ == PagePolicy::kStandard ?
+                          "standard" :
+                          (kPagePolicy_ == PagePolicy::kTransparentHuge ? "transparent huge" :
+                                                                          "explicit huge"));
     std::cout << encrypted << BytesToDecimalSiUnits(kTestDataSize_) << " of " << comp << " data in "
-              << BytesToDecimalSiUnits(kPieceSize_) << " pieces in " << (duration / 1000)
-              << " milliseconds at a speed of " << BytesToDecimalSiUnits(rate) << "/s\n";
+              << BytesToDecimalSiUnits(kPieceSize_) << " pieces (" << pages << " pages) in "
+              << (duration / 1000) << " milliseconds at a speed of "
+              << BytesToDecimalSiUnits(rate) << "/s\n";
   }
   void WriteThenRead(bool compressible) {
     chrono_time_point start_time(std::chrono::high_resolution_clock::now());
@@ -80,6 +164,7 @@ class Benchmark : public EncryptTestBase, public testing::TestWithParam<uint32_t
     self_encryptor_->Close();
   }
   const uint32_t kTestDataSize_, kPieceSize_;
+  const PagePolicy kPagePolicy_;
 };
 
 TEST_P(Benchmark, FUNC_BenchmarkCompressible) {
@@ -92,40 +177,293 @@ TEST_P(Benchmark, FUNC_BenchmarkIncompressible) {
   WriteThenRead(false);
 }
 
-INSTANTIATE_TEST_CASE_P(WriteRead, Benchmark, testing::Values(0, 4096, 65536, 1048576));
-
-// This test is to allow confirmation that memory usage is capped at an
-// acceptable level.  While the test is running, memory usage must be visually
-// monitored.
-TEST(MassiveFile, FUNC_MemCheck) {
-  maidsafe::test::TestPath test_dir(maidsafe::test::CreateTestPath());
-  fs::path store_path(*test_dir / "data_store");
-  DataBuffer buffer(MemoryUsage(4294967296U), DiskUsage(4294967296U),
-                    [](const DataBuffer::KeyType& name, const NonEmptyString&) {
-                      LOG(kError) << "Buffer full - deleting " << base64::Substr(name.name);
-                      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
-                    },
-                    store_path);
-
-  DataMap data_map;
-  std::unique_ptr<SelfEncryptor> self_encryptor(
-      new SelfEncryptor(data_map, buffer, [&buffer](const std::string& name) {
-        return buffer.Get(DataBuffer::KeyType(Identity(name), DataTypeId(0)));
-      }));
-
-  const uint32_t kDataSize((1 << 20) + 1);
-  std::unique_ptr<char> original(new char[kDataSize]);
-  std::string content(RandomString(kDataSize));
-  std::copy(content.data(), content.data() + kDataSize, original.get());
-
-  // Writes ~200MB
-  for (uint64_t offset(0); offset != 200 * kDataSize; offset += kDataSize)
-    EXPECT_TRUE(self_encryptor->Write(original.get(), kDataSize, offset));
-
-  LOG(kInfo) << "Resetting self encryptor.";
-  self_encryptor->Close();
+INSTANTIATE_TEST_CASE_P(WriteRead, Benchmark,
+                        testing::Combine(testing::Values(0, 4096, 65536, 1048576),
+                                         testing::Values(PagePolicy::kStandard,
+                                                         PagePolicy::kTransparentHuge,
+                                                         PagePolicy::kExplicitHuge)));
+
+// Runs a fixed workload of files over 1..N threads, each file with its own SelfEncryptor but all
+// sharing one DataBuffer, so that contention in the store and oversubscription from the
+// per-chunk tasks show up as a drop in aggregate throughput or a rise in close latency.
+struct Workload {
+  const char* name;
+  uint32_t min_file_size, max_file_size;  // file sizes are log-uniformly distributed
+  uint32_t file_count;
+  uint32_t reads_per_write;  // number of full read passes over each file after it's written
+};
+
+const std::vector<Workload> kWorkloads{{"small files, write only", 1024, 65536, 512, 0},
+                                       {"mixed files, write then read", 1024, 4194304, 128, 1},
+                                       {"large files, read heavy", 8388608, 8388608, 32, 3}};
+
+// Peak resident set size since the last call to ResetPeakResidentSetSize, or 0 if unsupported.
+uint64_t PeakResidentSetSize() {
+#if defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::stoull(line.substr(6)) * 1024;
+  }
+#endif
+  return 0;
+}
+
+void ResetPeakResidentSetSize() {
+#if defined(__linux__)
+  std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+class ConcurrentBenchmark : public testing::TestWithParam<std::tuple<uint32_t, size_t>> {
+ public:
+  typedef std::chrono::high_resolution_clock clock;
+
+  ConcurrentBenchmark()
+      : kThreadCount_(std::get<0>(GetParam())),
+        kWorkload_(kWorkloads[std::get<1>(GetParam())]),
+        test_dir_(maidsafe::test::CreateTestPath()),
+        buffer_(MemoryUsage(uint64_t(512) << 20), DiskUsage(uint64_t(16) << 30),
+                [](const DataBuffer::KeyType&, const NonEmptyString&) {
+                  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+                },
+                *test_dir_ / "data_store"),
+        get_from_store_([this](const std::string& name) {
+          return buffer_.Get(DataBuffer::KeyType(Identity(name), DataTypeId(0)));
+        }),
+        content_(RandomString(2 * kWorkload_.max_file_size)),
+        mismatches_(0) {}
+
+ protected:
+  // Returns the number of bytes written and read.
+  uint64_t ProcessFile(std::mt19937& rng, std::vector<clock::duration>& close_latencies) {
+    std::uniform_real_distribution<double> log_size(std::log(kWorkload_.min_file_size),
+                                                    std::log(kWorkload_.max_file_size));
+    const auto kFileSize(static_cast<uint32_t>(std::exp(log_size(rng))));
+    const uint32_t kPieceSize(std::min<uint32_t>(kFileSize, 1 << 20));
+    const char* const kContent(
+        &content_[std::uniform_int_distribution<uint32_t>(0, kWorkload_.max_file_size)(rng)]);
+
+    DataMap data_map;
+    {
+      SelfEncryptor self_encryptor(data_map, buffer_, get_from_store_);
+      for (uint32_t offset(0); offset < kFileSize; offset += kPieceSize) {
+        self_encryptor.Write(kContent + offset, std::min(kPieceSize, kFileSize - offset),
+                             offset);
+      }
+      auto start_time(clock::now());
+      self_encryptor.Close();
+      close_latencies.push_back(clock::now() - start_time);
+    }
+
+    std::unique_ptr<char[]> decrypted(new char[kPieceSize]);
+    for (uint32_t pass(0); pass != kWorkload_.reads_per_write; ++pass) {
+      SelfEncryptor self_encryptor(data_map, buffer_, get_from_store_);
+      for (uint32_t offset(0); offset < kFileSize; offset += kPieceSize) {
+        const uint32_t kLength(std::min(kPieceSize, kFileSize - offset));
+        if (!self_encryptor.Read(decrypted.get(), kLength, offset) ||
+            std::memcmp(decrypted.get(), kContent + offset, kLength) != 0) {
+          ++mismatches_;
+        }
+      }
+      self_encryptor.Close();
+    }
+    return uint64_t(kFileSize) * (1 + kWorkload_.reads_per_write);
+  }
+
+  void PrintResult(clock::duration elapsed, uint64_t bytes_processed,
+                   std::vector<clock::duration>& close_latencies, uint64_t peak_rss) {
+    std::sort(std::begin(close_latencies), std::end(close_latencies));
+    auto percentile([&](double fraction) {
+      size_t index(static_cast<size_t>(fraction * (close_latencies.size() - 1)));
+      return std::chrono::duration_cast<std::chrono::microseconds>(close_latencies[index])
+          .count();
+    });
+    auto duration(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    if (duration == 0)
+      duration = 1;
+    uint64_t rate((bytes_processed * 1000000) / duration);
+    std::cout << kWorkload_.name << " over " << kThreadCount_ << " thread"
+              << (kThreadCount_ == 1 ? "" : "s") << ": " << BytesToDecimalSiUnits(rate)
+              << "/s aggregate, close latency p50 " << percentile(0.5) << " us, p99 "
+              << percentile(0.99) << " us, peak RSS " << BytesToDecimalSiUnits(peak_rss) << '\n';
+  }
+
+  const uint32_t kThreadCount_;
+  const Workload kWorkload_;
+  maidsafe::test::TestPath test_dir_;
+  DataBuffer buffer_;
+  std::function<NonEmptyString(const std::string&)> get_from_store_;
+  const std::string content_;
+  std::atomic<uint32_t> mismatches_;
+};
+
+TEST_P(ConcurrentBenchmark, FUNC_Scaling) {
+  std::vector<std::vector<clock::duration>> close_latencies(kThreadCount_);
+  std::vector<uint64_t> bytes_processed(kThreadCount_, 0);
+  std::vector<std::thread> threads;
+  ResetPeakResidentSetSize();
+  auto start_time(clock::now());
+  for (uint32_t i(0); i != kThreadCount_; ++i) {
+    threads.emplace_back([&, i] {
+      std::mt19937 rng(RandomUint32());
+      for (uint32_t file(i); file < kWorkload_.file_count; file += kThreadCount_)
+        bytes_processed[i] += ProcessFile(rng, close_latencies[i]);
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  auto elapsed(clock::now() - start_time);
+
+  EXPECT_EQ(0U, mismatches_);
+  std::vector<clock::duration> all_close_latencies;
+  for (const auto& latencies : close_latencies)
+    all_close_latencies.insert(std::end(all_close_latencies), std::begin(latencies),
+                               std::end(latencies));
+  PrintResult(elapsed, std::accumulate(std::begin(bytes_processed), std::end(bytes_processed),
+                                       uint64_t(0)),
+              all_close_latencies, PeakResidentSetSize());
+}
+
+INSTANTIATE_TEST_CASE_P(Concurrent, ConcurrentBenchmark,
+                        testing::Combine(testing::Values(1, 2, 4, 8, 16, 32, 64),
+                                         testing::Range<size_t>(0, kWorkloads.size())));
+
+// Limits on the memory used by one pass over the file, given per MiB of file.
+struct PassBudget {
+  double peak_heap_bytes, peak_rss_bytes, allocated_bytes, allocations;
+};
+
+// Measures the memory used to encrypt, then decrypt, a file of 'file_size' bytes, failing if any
+// measurement exceeds its budget for that pass.
+struct MemoryBudget {
+  uint64_t file_size;
+  PassBudget encrypt, decrypt;
+};
+
+// Heap and RSS figures for one pass over the file.
+struct MemoryUsed {
+  uint64_t peak_heap_bytes, peak_rss_bytes, allocated_bytes, allocations;
+};
+
+class MemoryBenchmark : public testing::TestWithParam<MemoryBudget> {
+ public:
+  MemoryBenchmark()
+      : kBudget_(GetParam()),
+        kFileMiB_(static_cast<double>(kBudget_.file_size) / (1 << 20)),
+        test_dir_(maidsafe::test::CreateTestPath()),
+        buffer_(MemoryUsage(uint64_t(64) << 20), DiskUsage(uint64_t(1) << 40),
+                [](const DataBuffer::KeyType&, const NonEmptyString&) {
+                  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+                },
+                *test_dir_ / "data_store"),
+        get_from_store_([this](const std::string& name) {
+          return buffer_.Get(DataBuffer::KeyType(Identity(name), DataTypeId(0)));
+        }),
+        piece_(RandomString(kMaxChunkSize)),
+        data_map_() {}
+
+ protected:
+  void StartMeasuring() {
+    ResetPeakResidentSetSize();
+    start_allocations_ = g_allocations;
+    start_allocated_bytes_ = g_allocated_bytes;
+    start_live_bytes_ = g_live_bytes;
+    g_peak_live_bytes = start_live_bytes_;
+  }
+
+  MemoryUsed StopMeasuring() const {
+    MemoryUsed used;
+    used.peak_heap_bytes = g_peak_live_bytes - start_live_bytes_;
+    used.peak_rss_bytes = PeakResidentSetSize();
+    used.allocated_bytes = g_allocated_bytes - start_allocated_bytes_;
+    used.allocations = g_allocations - start_allocations_;
+    return used;
+  }
+
+  void CheckBudget(const std::string& pass, const PassBudget& budget,
+                   const MemoryUsed& used) const {
+    auto per_mib([this](uint64_t value) { return static_cast<double>(value) / kFileMiB_; });
+    std::cout << pass << ' ' << BytesToDecimalSiUnits(kBudget_.file_size) << ": peak heap "
+              << BytesToDecimalSiUnits(used.peak_heap_bytes) << ", peak RSS "
+              << BytesToDecimalSiUnits(used.peak_rss_bytes) << ", "
+              << BytesToDecimalSiUnits(used.allocated_bytes) << " in " << used.allocations
+              << " allocations\n";
+    EXPECT_LE(per_mib(used.peak_heap_bytes), budget.peak_heap_bytes) << pass;
+    if (used.peak_rss_bytes != 0)
+      EXPECT_LE(per_mib(used.peak_rss_bytes), budget.peak_rss_bytes) << pass;
+    EXPECT_LE(per_mib(used.allocated_bytes), budget.allocated_bytes) << pass;
+    EXPECT_LE(per_mib(used.allocations), budget.allocations) << pass;
+  }
+
+  // Every chunk-sized piece of the file is the same, so the store only holds a few chunks however
+  // large the file is.
+  void Encrypt() {
+    SelfEncryptor self_encryptor(data_map_, buffer_, get_from_store_);
+    for (uint64_t offset(0); offset < kBudget_.file_size; offset += kMaxChunkSize) {
+      ASSERT_TRUE(self_encryptor.Write(
+          piece_.data(),
+          static_cast<uint32_t>(std::min<uint64_t>(kMaxChunkSize, kBudget_.file_size - offset)),
+          offset));
+    }
+    self_encryptor.Close();
+  }
+
+  void Decrypt() {
+    SelfEncryptor self_encryptor(data_map_, buffer_, get_from_store_);
+    std::string decrypted(kMaxChunkSize, 0);
+    for (uint64_t offset(0); offset < kBudget_.file_size; offset += kMaxChunkSize) {
+      const auto kLength(
+          static_cast<uint32_t>(std::min<uint64_t>(kMaxChunkSize, kBudget_.file_size - offset)));
+      ASSERT_TRUE(self_encryptor.Read(&decrypted[0], kLength, offset));
+      ASSERT_EQ(0, piece_.compare(0, kLength, decrypted, 0, kLength)) << "failed @ " << offset;
+    }
+    self_encryptor.Close();
+  }
+
+  const MemoryBudget kBudget_;
+  const double kFileMiB_;
+  maidsafe::test::TestPath test_dir_;
+  DataBuffer buffer_;
+  std::function<NonEmptyString(const std::string&)> get_from_store_;
+  const std::string piece_;
+  DataMap data_map_;
+  uint64_t start_allocations_, start_allocated_bytes_, start_live_bytes_;
+};
+
+TEST_P(MemoryBenchmark, FUNC_EncryptDecryptWithinBudget) {
+  StartMeasuring();
+  Encrypt();
+  CheckBudget("Encrypting", kBudget_.encrypt, StopMeasuring());
+
+  StartMeasuring();
+  Decrypt();
+  CheckBudget("Decrypting", kBudget_.decrypt, StopMeasuring());
 }
 
+// Until Close, SelfEncryptor holds the whole file in its sequencer.  Close then encrypts every
+// chunk concurrently, each holding several copies of its chunk, so encrypting peaks at around five
+// times the file size on the heap.  Closing after only reading encrypts nothing, so decrypting
+// holds little more than the sequencer.  The budgets leave roughly 20% above the figures measured
+// for a 100 MiB file, encrypting then decrypting: peak heap 5.0 and 1.06 MiB, 6.0 and 7.0 MiB
+// allocated, and 31 and 23 allocations per MiB of file.  Decrypting's RSS budget is looser, since
+// pages freed after encrypting may not yet have been returned to the system.
+const double kMiB(1 << 20);
+const PassBudget kEncryptBudget{6 * kMiB, 6.5 * kMiB, 7.5 * kMiB, 38};
+const PassBudget kDecryptBudget{1.3 * kMiB, 5 * kMiB, 8.5 * kMiB, 28};
+
+INSTANTIATE_TEST_CASE_P(Files, MemoryBenchmark,
+                        testing::Values(MemoryBudget{uint64_t(100) << 20, kEncryptBudget,
+                                                     kDecryptBudget}));
+
+// These need memory several times the file size; run with --gtest_also_run_disabled_tests.
+INSTANTIATE_TEST_CASE_P(DISABLED_LargeFiles, MemoryBenchmark,
+                        testing::Values(MemoryBudget{uint64_t(1) << 30, kEncryptBudget,
+                                                     kDecryptBudget},
+                                        MemoryBudget{uint64_t(10) << 30, kEncryptBudget,
+                                                     kDecryptBudget}));
+
 }  // namespace test
 
 }  // namespace encrypt
@@ -0,0 +1,96 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <cstdint>
+#include <string>
+
+#ifdef __MSVC__
+#pragma warning(push, 1)
+#endif
+#include "cryptopp/aes.h"
+#include "cryptopp/modes.h"
+#ifdef __MSVC__
+#pragma warning(pop)
+#endif
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/cfb.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+namespace {
+
+byte* Bytes(std::string& data) { return reinterpret_cast<byte*>(&data[0]); }
+
+}  // unnamed namespace
+
+// Covers empty input, partial blocks on either side of the 8-block interleave, and a whole chunk.
+TEST(CfbTest, BEH_MatchesCryptoPP) {
+  LOG(kInfo) << "AES-NI " << (CfbUsesAesNi() ? "is" : "isn't") << " in use.";
+  for (uint32_t size : {0U, 1U, 15U, 16U, 17U, 127U, 128U, 129U, 255U, 256U, 1000U, 1048579U}) {
+    std::string key(RandomString(crypto::AES256_KeySize)), iv(RandomString(crypto::AES256_IVSize));
+    const std::string kPlainText(RandomString(size));
+
+    std::string expected(kPlainText);
+    CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryptor(Bytes(key), crypto::AES256_KeySize,
+                                                            Bytes(iv));
+    encryptor.ProcessData(Bytes(expected), Bytes(expected), size);
+    std::string encrypted(kPlainText);
+    CfbEncrypt(Bytes(key), Bytes(iv), Bytes(encrypted), size);
+    EXPECT_EQ(expected, encrypted) << size;
+
+    CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryptor(Bytes(key), crypto::AES256_KeySize,
+                                                            Bytes(iv));
+    decryptor.ProcessData(Bytes(expected), Bytes(expected), size);
+    std::string decrypted(encrypted);
+    CfbDecrypt(Bytes(key), Bytes(iv), Bytes(decrypted), size);
+    EXPECT_EQ(expected, decrypted) << size;
+    EXPECT_EQ(kPlainText, decrypted) << size;
+  }
+}
+
+TEST(CfbTest, BEH_DecryptIsPositionDependent) {
+  std::string key(RandomString(crypto::AES256_KeySize)), iv(RandomString(crypto::AES256_IVSize));
+  const std::string kPlainText(RandomString(64 * 16));
+  std::string encrypted(kPlainText);
+  CfbEncrypt(Bytes(key), Bytes(iv), Bytes(encrypted), encrypted.size());
+
+  // corrupting one ciphertext byte garbles that byte and the whole of the following block only
+  const size_t kCorrupted(9 * 16 + 3);
+  encrypted[kCorrupted] ^= 1;
+  std::string decrypted(encrypted);
+  CfbDecrypt(Bytes(key), Bytes(iv), Bytes(decrypted), decrypted.size());
+  EXPECT_EQ(kPlainText.substr(0, kCorrupted), decrypted.substr(0, kCorrupted));
+  EXPECT_NE(kPlainText[kCorrupted], decrypted[kCorrupted]);
+  EXPECT_NE(kPlainText.substr(10 * 16, 16), decrypted.substr(10 * 16, 16));
+  EXPECT_EQ(kPlainText.substr(11 * 16), decrypted.substr(11 * 16));
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,237 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boost/filesystem/fstream.hpp"
+#include "boost/filesystem/operations.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/batch_encryptor.h"
+#include "maidsafe/encrypt/chunk_sink.h"
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/metrics.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace fs = boost::filesystem;
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+namespace {
+
+// Holds up every batch until Release is called.
+class BlockingSink : public ChunkSink {
+ public:
+  BlockingSink() : mutex_(), condition_(), released_(false), calls_(0), chunk_count_(0) {}
+
+  virtual void Store(std::vector<EncryptedChunk> batch) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++calls_;
+    condition_.notify_all();
+    condition_.wait(lock, [this] { return released_; });
+    chunk_count_ += batch.size();
+  }
+  void WaitForFirstCall() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] { return calls_ != 0; });
+  }
+  void Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    released_ = true;
+    condition_.notify_all();
+  }
+  size_t chunk_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunk_count_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool released_;
+  int calls_;
+  size_t chunk_count_;
+};
+
+class FailingSink : public ChunkSink {
+ public:
+  virtual void Store(std::vector<EncryptedChunk> /*batch*/) override {
+    BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+  }
+};
+
+}  // unnamed namespace
+
+class ChunkSinkTest : public EncryptTestBase, public testing::Test {
+ protected:
+  virtual void TearDown() override { self_encryptor_->Close(); }
+};
+
+TEST_F(ChunkSinkTest, BEH_DirectorySinkRoundTrip) {
+  DirectoryChunkSink sink(*test_dir_ / "chunks");
+  auto get_from_directory([&](const std::string& name) {
+    fs::ifstream input(sink.ChunkPath(name), std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    return NonEmptyString(content);
+  });
+  const std::string kContent(RandomString(4 * kMaxChunkSize + 10));
+  DataMap data_map;
+  {
+    SelfEncryptor self_encryptor(data_map, sink, get_from_directory);
+    EXPECT_TRUE(self_encryptor.Write(kContent.data(), static_cast<uint32_t>(kContent.size()), 0));
+    self_encryptor.Close();
+  }
+  ASSERT_EQ(5, data_map.chunks.size());
+  for (const auto& chunk : data_map.chunks) {
+    EXPECT_TRUE(
+        fs::exists(sink.ChunkPath(std::string(std::begin(chunk.hash), std::end(chunk.hash)))));
+  }
+  // the file is reopened and changed, so only some chunks are new
+  std::string read(kContent.size(), 0);
+  {
+    SelfEncryptor self_encryptor(data_map, sink, get_from_directory);
+    EXPECT_TRUE(self_encryptor.Write("changed", 7, 2 * kMaxChunkSize));
+    EXPECT_TRUE(self_encryptor.Read(&read[0], static_cast<uint32_t>(read.size()), 0));
+    self_encryptor.Close();
+  }
+  std::string expected(kContent);
+  expected.replace(2 * kMaxChunkSize, 7, "changed");
+  EXPECT_TRUE(expected == read);
+  {
+    SelfEncryptor self_encryptor(data_map, sink, get_from_directory);
+    EXPECT_TRUE(self_encryptor.Read(&read[0], static_cast<uint32_t>(read.size()), 0));
+    self_encryptor.Close();
+  }
+  EXPECT_TRUE(expected == read);
+}
+
+TEST_F(ChunkSinkTest, BEH_NullSinkCountsBatches) {
+  std::vector<std::string> contents;
+  std::vector<BatchFile> files;
+  for (int i(0); i != 7; ++i)
+    contents.push_back(RandomString(3 * kMinChunkSize + i));
+  for (const auto& content : contents)
+    files.emplace_back(content.data(), content.size());
+  NullChunkSink sink;
+  ChunkSinkOptions options;
+  options.batch_size = 4;
+  auto data_maps(EncryptFiles(files, sink, options));
+  EXPECT_EQ(21, sink.chunk_count());
+  EXPECT_EQ(6, sink.batch_count());  // five full batches and a last one holding a single chunk
+  for (size_t i(0); i != data_maps.size(); ++i) {
+    EXPECT_EQ(3, data_maps[i].chunks.size());
+    EXPECT_EQ(contents[i].size(), data_maps[i].size());
+  }
+  EXPECT_THROW(get_from_store_(std::string(std::begin(data_maps[0].chunks[0].hash),
+                                           std::end(data_maps[0].chunks[0].hash))),
+               common_error);
+}
+
+TEST_F(ChunkSinkTest, BEH_SlowSinkHoldsUpEncryption) {
+  const size_t kFileCount(8);
+  std::vector<std::string> contents;
+  std::vector<BatchFile> files;
+  for (size_t i(0); i != kFileCount; ++i)
+    contents.push_back(RandomString(3 * kMinChunkSize));
+  for (const auto& content : contents)
+    files.emplace_back(content.data(), content.size());
+  BlockingSink sink;
+  ChunkSinkOptions options;
+  options.batch_size = 1;
+  options.max_pending_batches = 1;
+  ResetMetrics();
+  auto result(std::async(std::launch::async, [&] { return EncryptFiles(files, sink, options); }));
+  sink.WaitForFirstCall();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  // one chunk is with the sink and one is queued; every encrypting thread is blocked behind them
+  EXPECT_LE(GetMetrics().chunks_encrypted, 2U);
+  EXPECT_EQ(std::future_status::timeout, result.wait_for(std::chrono::seconds(0)));
+  sink.Release();
+  EXPECT_EQ(kFileCount, result.get().size());
+  EXPECT_EQ(3 * kFileCount, sink.chunk_count());
+  EXPECT_EQ(3 * kFileCount, GetMetrics().chunks_encrypted);
+}
+
+TEST_F(ChunkSinkTest, BEH_SinkFailureIsRethrown) {
+  const std::string kContent(RandomString(5 * kMaxChunkSize));
+  FailingSink sink;
+  ChunkSinkOptions options;
+  options.batch_size = 2;
+  options.max_pending_batches = 1;
+  EXPECT_THROW(EncryptFiles(std::vector<BatchFile>(1, BatchFile(kContent.data(), kContent.size())),
+                            sink, options),
+               common_error);
+}
+
+TEST_F(ChunkSinkTest, BEH_ReadsContinueWhileFailedCloseAsyncRollsBack) {
+  std::string content(RandomString(10 * kMaxChunkSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), static_cast<uint32_t>(content.size()), 0));
+  self_encryptor_->Close();
+  const DataMap kOriginal(data_map_);
+
+  // appending grows data_map_ in BeginClose, and the failed store shrinks it again while readers
+  // decrypt the chunks left remote
+  FailingSink sink;
+  {
+    SelfEncryptor self_encryptor(data_map_, sink, get_from_store_, ChunkSinkOptions());
+    const std::string kAppended(RandomString(4 * kMaxChunkSize));
+    EXPECT_TRUE(self_encryptor.Write(kAppended.data(), static_cast<uint32_t>(kAppended.size()),
+                                     content.size()));
+    content += kAppended;
+    auto closed(self_encryptor.CloseAsync().share());
+    std::vector<std::thread> readers;
+    for (uint32_t i(0); i != 4; ++i) {
+      readers.emplace_back([&, i, closed] {
+        const uint64_t kPosition((2 + i) * kMaxChunkSize + 10);
+        std::string answer(3 * kMaxChunkSize, 0);
+        do {
+          EXPECT_TRUE(self_encryptor.Read(&answer[0], static_cast<uint32_t>(answer.size()),
+                                          kPosition));
+          EXPECT_TRUE(content.substr(kPosition, answer.size()) == answer) << i;
+        } while (closed.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+      });
+    }
+    for (auto& reader : readers)
+      reader.join();
+    EXPECT_THROW(closed.get(), common_error);
+    self_encryptor.Close();
+  }
+  EXPECT_EQ(kOriginal, data_map_);
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
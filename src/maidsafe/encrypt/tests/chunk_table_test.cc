@@ -0,0 +1,96 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "maidsafe/common/test.h"
+
+#include "maidsafe/encrypt/chunk_table.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+TEST(ChunkTableTest, BEH_ResizeSetAndInsert) {
+  ChunkTable table;
+  EXPECT_EQ(0, table.size());
+  EXPECT_EQ(ChunkStatus::absent, table.Get(0));
+
+  table.Resize(3, ChunkStatus::remote);
+  EXPECT_EQ(3, table.size());
+  for (uint32_t chunk(0); chunk != 3; ++chunk)
+    EXPECT_EQ(ChunkStatus::remote, table.Get(chunk));
+  EXPECT_EQ(ChunkStatus::absent, table.Get(3));
+
+  // growing past the capacity keeps existing entries
+  table.Set(1000, ChunkStatus::stored);
+  EXPECT_EQ(1001, table.size());
+  EXPECT_EQ(ChunkStatus::remote, table.Get(2));
+  EXPECT_EQ(ChunkStatus::absent, table.Get(3));
+  EXPECT_EQ(ChunkStatus::stored, table.Get(1000));
+
+  EXPECT_FALSE(table.Insert(0, ChunkStatus::to_be_hashed));
+  EXPECT_EQ(ChunkStatus::remote, table.Get(0));
+  EXPECT_TRUE(table.Insert(3, ChunkStatus::to_be_hashed));
+  EXPECT_EQ(ChunkStatus::to_be_hashed, table.Get(3));
+  EXPECT_TRUE(table.Insert(2000, ChunkStatus::to_be_hashed));
+  EXPECT_EQ(2001, table.size());
+
+  // shrinking drops entries, which read back as absent once regrown
+  table.Resize(2);
+  EXPECT_EQ(ChunkStatus::absent, table.Get(2));
+  table.Resize(5);
+  EXPECT_EQ(ChunkStatus::remote, table.Get(1));
+  EXPECT_EQ(ChunkStatus::absent, table.Get(2));
+  EXPECT_EQ(ChunkStatus::absent, table.Get(4));
+}
+
+TEST(ChunkTableTest, BEH_ConcurrentTransitions) {
+  const uint32_t kChunkCount(10000);
+  ChunkTable table;
+  table.Resize(kChunkCount, ChunkStatus::to_be_encrypted);
+  // every chunk is claimed by exactly one thread
+  std::vector<std::thread> threads;
+  std::vector<uint32_t> claimed(4, 0);
+  for (size_t i(0); i != claimed.size(); ++i) {
+    threads.emplace_back([&, i] {
+      for (uint32_t chunk(0); chunk != kChunkCount; ++chunk) {
+        if (table.Transition(chunk, ChunkStatus::to_be_encrypted, ChunkStatus::stored))
+          ++claimed[i];
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  uint32_t total(0);
+  for (auto count : claimed)
+    total += count;
+  EXPECT_EQ(kChunkCount, total);
+  for (uint32_t chunk(0); chunk != kChunkCount; ++chunk)
+    EXPECT_EQ(ChunkStatus::stored, table.Get(chunk));
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
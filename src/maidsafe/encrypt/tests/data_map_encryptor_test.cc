@@ -20,6 +20,7 @@
 #include <array>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #ifdef WIN32
 #pragma warning(push, 1)
@@ -110,6 +111,44 @@ TEST_F(EncryptDataMapTest, FUNC_EncryptDecryptDataMap) {
     EXPECT_EQ(decrypted_[i], original_[i]);
 }
 
+TEST_F(EncryptDataMapTest, BEH_EncryptDecryptDataMaps) {
+  EXPECT_TRUE(self_encryptor_->Write(&original_[0], 5 * kMaxChunkSize, 0));
+  EXPECT_NO_THROW(self_encryptor_->Close());
+  const Identity kParentId(MakeIdentity());
+  const size_t kCount(100);
+  std::vector<Identity> this_ids;
+  std::vector<DataMap> data_maps(kCount);
+  for (size_t i(0); i < kCount; ++i) {
+    this_ids.push_back(MakeIdentity());
+    if (i % 2 == 0) {
+      data_maps[i] = data_map_;
+    } else {
+      std::string content(RandomString(i));
+      data_maps[i].content.assign(std::begin(content), std::end(content));
+    }
+  }
+
+  std::vector<SerialisedData> encrypted_data_maps(
+      EncryptDataMaps(kParentId, this_ids, data_maps));
+  ASSERT_EQ(kCount, encrypted_data_maps.size());
+  for (size_t i(0); i < kCount; ++i) {
+    EXPECT_EQ(EncryptDataMap(kParentId, this_ids[i], data_maps[i]), encrypted_data_maps[i]);
+    EXPECT_EQ(data_maps[i], DecryptDataMap(kParentId, this_ids[i], encrypted_data_maps[i]));
+  }
+
+  std::vector<DataMap> decrypted_data_maps(
+      DecryptDataMaps(kParentId, this_ids, encrypted_data_maps));
+  ASSERT_EQ(kCount, decrypted_data_maps.size());
+  for (size_t i(0); i < kCount; ++i)
+    EXPECT_EQ(data_maps[i], decrypted_data_maps[i]);
+
+  EXPECT_TRUE(DecryptDataMaps(kParentId, std::vector<Identity>(),
+                              std::vector<SerialisedData>()).empty());
+  this_ids.pop_back();
+  EXPECT_THROW(EncryptDataMaps(kParentId, this_ids, data_maps), common_error);
+  EXPECT_THROW(DecryptDataMaps(kParentId, this_ids, encrypted_data_maps), common_error);
+}
+
 TEST_F(EncryptDataMapTest, BEH_DifferentDataMapSameChunk) {
   DataMap data_map_1, data_map_2;
   {
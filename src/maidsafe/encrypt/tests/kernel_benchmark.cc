@@ -0,0 +1,457 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+// Microbenchmarks of the individual chunk-level kernels.  Each reports bytes/s and heap
+// allocations (count and bytes) per operation, sweeping chunk size and, where it matters, data
+// entropy.  For output which can be diffed between builds, run with e.g.
+//   kernel_benchmark_encrypt --benchmark_out=kernels.json --benchmark_out_format=json
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#ifdef __MSVC__
+#pragma warning(push, 1)
+#endif
+#include "cryptopp/aes.h"
+#include "cryptopp/gzip.h"
+#include "cryptopp/modes.h"
+#include "cryptopp/sha.h"
+#ifdef __MSVC__
+#pragma warning(pop)
+#endif
+
+#include "maidsafe/common/crypto.h"
+#include "maidsafe/common/data_buffer.h"
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/common/serialisation/serialisation.h"
+
+#include "maidsafe/encrypt/cfb.h"
+#include "maidsafe/encrypt/chunk_crypto.h"
+#include "maidsafe/encrypt/chunk_sink.h"
+#include "maidsafe/encrypt/chunk_sink_queue.h"
+#include "maidsafe/encrypt/data_map.h"
+#include "maidsafe/encrypt/data_map_encryptor.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/xor.h"
+
+namespace {
+
+// Every heap allocation made by this executable is counted.  As in benchmark.cc, each is prefixed
+// with a header so that the pointer handed back to std::free is the one std::malloc returned.
+const size_t kAllocationHeaderSize(alignof(std::max_align_t));
+std::atomic<uint64_t> g_allocation_count(0), g_allocated_bytes(0);
+
+void* Allocate(std::size_t size) {
+  char* memory(static_cast<char*>(std::malloc(size + kAllocationHeaderSize)));
+  if (!memory)
+    return nullptr;
+  g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  return memory + kAllocationHeaderSize;
+}
+
+void Deallocate(void* pointer) {
+  if (pointer)
+    std::free(static_cast<char*>(pointer) - kAllocationHeaderSize);
+}
+
+}  // unnamed namespace
+
+void* operator new(std::size_t size) {
+  if (void* memory = Allocate(size))
+    return memory;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void operator delete(void* pointer) noexcept { Deallocate(pointer); }
+
+void operator delete[](void* pointer) noexcept { Deallocate(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept { Deallocate(pointer); }
+
+void operator delete[](void* pointer, std::size_t) noexcept { Deallocate(pointer); }
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { Deallocate(pointer); }
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { Deallocate(pointer); }
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+// Gives the benchmarks access to SelfEncryptor's per-chunk members.  Wraps a closed three-chunk
+// file of 'chunk_size' chunks.  Chunks encrypted by EncryptChunk are discarded, while those
+// encrypted by StoreChunk are kept in buffer_ so DecryptChunk can fetch them.
+class SelfEncryptorKernels {
+ public:
+  explicit SelfEncryptorKernels(uint32_t chunk_size)
+      : buffer_(MemoryUsage(uint64_t(1) << 32), DiskUsage(uint64_t(1) << 32),
+                [](const DataBuffer::KeyType&, const NonEmptyString&) {
+                  BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+                }),
+        data_map_(),
+        self_encryptor_(),
+        null_sink_(),
+        sink_queue_(null_sink_, ChunkSinkOptions()),
+        buffer_sink_(buffer_) {
+    const std::string content(RandomString(3 * chunk_size));
+    {
+      SelfEncryptor writer(data_map_, buffer_, GetFromStore());
+      writer.Write(content.data(), static_cast<uint32_t>(content.size()), 0);
+      writer.Close();
+    }
+    self_encryptor_.reset(new SelfEncryptor(data_map_, buffer_, GetFromStore()));
+  }
+  ~SelfEncryptorKernels() {
+    self_encryptor_->Close();
+    sink_queue_.Flush();
+  }
+
+  const ChunkKeys& GetPadIvKey(uint32_t chunk) { return *self_encryptor_->GetPadIvKey(chunk); }
+  void InvalidatePadIvKey(uint32_t chunk) { self_encryptor_->InvalidatePadIvKey(chunk); }
+  void EncryptChunk(uint32_t chunk, const ByteVector& data) {
+    self_encryptor_->EncryptChunk(chunk, data, static_cast<uint32_t>(data.size()), sink_queue_);
+  }
+  void StoreChunk(uint32_t chunk, const ByteVector& data) {
+    ChunkSinkQueue store_queue(buffer_sink_, ChunkSinkOptions());
+    self_encryptor_->EncryptChunk(chunk, data, static_cast<uint32_t>(data.size()), store_queue);
+    store_queue.Flush();
+  }
+  ByteVector DecryptChunk(uint32_t chunk) { return self_encryptor_->DecryptChunk(chunk); }
+
+ private:
+  std::function<NonEmptyString(const std::string&)> GetFromStore() {
+    return [this](const std::string& name) {
+      return buffer_.Get(DataBuffer::KeyType(Identity(name), DataTypeId(0)));
+    };
+  }
+
+  DataBuffer buffer_;
+  DataMap data_map_;
+  std::unique_ptr<SelfEncryptor> self_encryptor_;
+  NullChunkSink null_sink_;
+  ChunkSinkQueue sink_queue_;
+  DataBufferChunkSink buffer_sink_;
+};
+
+}  // namespace test
+
+namespace {
+
+enum Entropy : int64_t { kRepetitive = 0, kRandom = 1 };
+
+const std::vector<int64_t> kChunkSizes{4096, 65536, 1 << 20};
+
+// Reports the average number of heap allocations, and of bytes allocated, per iteration of 'state'
+// over its lifetime.
+class AllocationCounter {
+ public:
+  explicit AllocationCounter(benchmark::State& state)
+      : state_(state), kStart_(g_allocation_count), kStartBytes_(g_allocated_bytes) {}
+  ~AllocationCounter() {
+    state_.counters["allocs_per_op"] = benchmark::Counter(
+        static_cast<double>(g_allocation_count - kStart_), benchmark::Counter::kAvgIterations);
+    state_.counters["bytes_allocated_per_op"] =
+        benchmark::Counter(static_cast<double>(g_allocated_bytes - kStartBytes_),
+                           benchmark::Counter::kAvgIterations);
+  }
+
+ private:
+  benchmark::State& state_;
+  const uint64_t kStart_, kStartBytes_;
+};
+
+ByteVector MakeData(size_t size, int64_t entropy) {
+  std::string data;
+  if (entropy == kRandom) {
+    data = RandomString(size);
+  } else {
+    // a short random block repeated, which gzip reduces to a few percent
+    const std::string block(RandomString(256));
+    while (data.size() < size)
+      data += block;
+    data.resize(size);
+  }
+  return ByteVector(std::begin(data), std::end(data));
+}
+
+void ReportThroughput(benchmark::State& state, int64_t entropy) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+  state.SetLabel(entropy == kRandom ? "random" : "repetitive");
+}
+
+void ChunkSizes(benchmark::internal::Benchmark* benchmark) {
+  for (auto size : kChunkSizes)
+    benchmark->Args({size});
+}
+
+void ChunkSizesAndEntropy(benchmark::internal::Benchmark* benchmark) {
+  for (auto size : kChunkSizes) {
+    for (auto entropy : {kRepetitive, kRandom})
+      benchmark->Args({size, entropy});
+  }
+}
+
+DataMap MakeDataMap(int64_t chunk_count) {
+  DataMap data_map;
+  for (int64_t i(0); i < chunk_count; ++i) {
+    ChunkDetails chunk;
+    chunk.hash = MakeData(crypto::SHA512::DIGESTSIZE, kRandom);
+    chunk.pre_hash = MakeData(crypto::SHA512::DIGESTSIZE, kRandom);
+    chunk.size = kMaxChunkSize;
+    data_map.chunks.push_back(chunk);
+  }
+  return data_map;
+}
+
+void BM_XorFilter(benchmark::State& state) {
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), kRandom));
+  ByteVector pad(MakeData(kPadSize, kRandom));
+  std::string output;
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+      output.clear();
+      XORFilter filter(new CryptoPP::StringSink(output), &pad.data()[0]);
+      filter.Put2(&data.data()[0], data.size(), -1, true);
+      benchmark::DoNotOptimize(output.data());
+    }
+  }
+  ReportThroughput(state, kRandom);
+}
+BENCHMARK(BM_XorFilter)->Apply(ChunkSizes);
+
+void BM_ApplyPad(benchmark::State& state) {
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), kRandom));
+  ByteVector pad(MakeData(kPadSize, kRandom));
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+      ApplyPad(&data.data()[0], data.size(), &pad.data()[0]);
+      benchmark::DoNotOptimize(data.data());
+    }
+  }
+  ReportThroughput(state, kRandom);
+}
+BENCHMARK(BM_ApplyPad)->Apply(ChunkSizes);
+
+// Arg 1 is 1 for the library kernel, 0 for CryptoPP::CFB_Mode.
+template <bool kEncrypt>
+void BM_Cfb(benchmark::State& state) {
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), kRandom));
+  ByteVector key(MakeData(crypto::AES256_KeySize, kRandom));
+  ByteVector iv(MakeData(crypto::AES256_IVSize, kRandom));
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+      if (state.range(1) == 1) {
+        if (kEncrypt)
+          CfbEncrypt(&key.data()[0], &iv.data()[0], &data.data()[0], data.size());
+        else
+          CfbDecrypt(&key.data()[0], &iv.data()[0], &data.data()[0], data.size());
+      } else if (kEncrypt) {
+        CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryptor(
+            &key.data()[0], crypto::AES256_KeySize, &iv.data()[0]);
+        encryptor.ProcessData(&data.data()[0], &data.data()[0], data.size());
+      } else {
+        CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryptor(
+            &key.data()[0], crypto::AES256_KeySize, &iv.data()[0]);
+        decryptor.ProcessData(&data.data()[0], &data.data()[0], data.size());
+      }
+      benchmark::DoNotOptimize(data.data());
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+  state.SetLabel(state.range(1) == 1 ? (CfbUsesAesNi() ? "aes-ni" : "fallback") : "cryptopp");
+}
+
+void ChunkSizesAndCfbKernel(benchmark::internal::Benchmark* benchmark) {
+  for (auto size : kChunkSizes) {
+    for (int64_t kernel : {0, 1})
+      benchmark->Args({size, kernel});
+  }
+}
+BENCHMARK_TEMPLATE(BM_Cfb, true)->Apply(ChunkSizesAndCfbKernel);
+BENCHMARK_TEMPLATE(BM_Cfb, false)->Apply(ChunkSizesAndCfbKernel);
+
+// Arg 0 is 1 to derive the key material on every call, 0 to take it from the per-chunk cache.
+void BM_GetPadIvKey(benchmark::State& state) {
+  test::SelfEncryptorKernels kernels(kMaxChunkSize);
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+      if (state.range(0) == 1)
+        kernels.InvalidatePadIvKey(1);
+      benchmark::DoNotOptimize(kernels.GetPadIvKey(1).pad.data());
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.SetLabel(state.range(0) == 1 ? "derived" : "cached");
+}
+BENCHMARK(BM_GetPadIvKey)->Arg(0)->Arg(1);
+
+void BM_EncryptChunk(benchmark::State& state) {
+  test::SelfEncryptorKernels kernels(static_cast<uint32_t>(state.range(0)));
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), state.range(1)));
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      kernels.EncryptChunk(1, data);
+  }
+  ReportThroughput(state, state.range(1));
+}
+BENCHMARK(BM_EncryptChunk)->Apply(ChunkSizesAndEntropy);
+
+void BM_DecryptChunk(benchmark::State& state) {
+  test::SelfEncryptorKernels kernels(static_cast<uint32_t>(state.range(0)));
+  kernels.StoreChunk(1, MakeData(static_cast<size_t>(state.range(0)), state.range(1)));
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      benchmark::DoNotOptimize(kernels.DecryptChunk(1));
+  }
+  ReportThroughput(state, state.range(1));
+}
+BENCHMARK(BM_DecryptChunk)->Apply(ChunkSizesAndEntropy);
+
+void BM_Gzip(benchmark::State& state) {
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), state.range(1)));
+  std::string compressed;
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+      compressed.clear();
+      CryptoPP::Gzip compressor(new CryptoPP::StringSink(compressed), 1);
+      compressor.Put2(&data.data()[0], data.size(), -1, true);
+    }
+  }
+  ReportThroughput(state, state.range(1));
+  state.counters["ratio"] = static_cast<double>(compressed.size()) / data.size();
+}
+BENCHMARK(BM_Gzip)->Apply(ChunkSizesAndEntropy);
+
+void BM_Gunzip(benchmark::State& state) {
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), state.range(1)));
+  std::string compressed;
+  CryptoPP::Gzip compressor(new CryptoPP::StringSink(compressed), 1);
+  compressor.Put2(&data.data()[0], data.size(), -1, true);
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+      CryptoPP::Gunzip decompressor(new CryptoPP::ArraySink(&data.data()[0], data.size()));
+      decompressor.Put2(reinterpret_cast<const byte*>(compressed.data()), compressed.size(), -1,
+                        true);
+    }
+  }
+  ReportThroughput(state, state.range(1));
+}
+BENCHMARK(BM_Gunzip)->Apply(ChunkSizesAndEntropy);
+
+void BM_Sha512(benchmark::State& state) {
+  ByteVector data(MakeData(static_cast<size_t>(state.range(0)), kRandom));
+  ByteVector digest(crypto::SHA512::DIGESTSIZE);
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      CryptoPP::SHA512().CalculateDigest(&digest.data()[0], &data.data()[0], data.size());
+  }
+  ReportThroughput(state, kRandom);
+}
+BENCHMARK(BM_Sha512)->Apply(ChunkSizes);
+
+// The remaining benchmarks sweep the number of chunks in the data map.
+void DataMapChunkCounts(benchmark::internal::Benchmark* benchmark) {
+  for (int64_t chunk_count : {3, 100, 10000})
+    benchmark->Args({chunk_count});
+}
+
+void BM_EncryptDataMap(benchmark::State& state) {
+  const DataMap data_map(MakeDataMap(state.range(0)));
+  const Identity parent_id(MakeIdentity()), this_id(MakeIdentity());
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      benchmark::DoNotOptimize(EncryptDataMap(parent_id, this_id, data_map));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(Serialise(data_map).size()));
+}
+BENCHMARK(BM_EncryptDataMap)->Apply(DataMapChunkCounts);
+
+void BM_DecryptDataMap(benchmark::State& state) {
+  const DataMap data_map(MakeDataMap(state.range(0)));
+  const Identity parent_id(MakeIdentity()), this_id(MakeIdentity());
+  const SerialisedData encrypted(EncryptDataMap(parent_id, this_id, data_map));
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      benchmark::DoNotOptimize(DecryptDataMap(parent_id, this_id, encrypted));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(encrypted.size()));
+}
+BENCHMARK(BM_DecryptDataMap)->Apply(DataMapChunkCounts);
+
+void BM_SerialiseDataMap(benchmark::State& state) {
+  const DataMap data_map(MakeDataMap(state.range(0)));
+  size_t size(0);
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      size = Serialise(data_map).size();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_SerialiseDataMap)->Apply(DataMapChunkCounts);
+
+void BM_ParseDataMap(benchmark::State& state) {
+  const SerialisedData serialised(Serialise(MakeDataMap(state.range(0))));
+  {
+    AllocationCounter allocations(state);
+    for (auto _ : state)
+      benchmark::DoNotOptimize(Parse<DataMap>(serialised));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(serialised.size()));
+}
+BENCHMARK(BM_ParseDataMap)->Apply(DataMapChunkCounts);
+
+}  // unnamed namespace
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+BENCHMARK_MAIN();
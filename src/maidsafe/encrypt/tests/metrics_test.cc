@@ -0,0 +1,163 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/metrics.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+class MetricsTest : public EncryptTestBase, public testing::Test {};
+
+TEST_F(MetricsTest, BEH_PhasesRecorded) {
+  const uint32_t kChunkCount(5);
+  const uint32_t kDataSize(kChunkCount * kMaxChunkSize);
+  const std::string content(RandomString(kDataSize));
+  ResetMetrics();
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  MetricsSnapshot metrics(GetMetrics());
+  EXPECT_EQ(kChunkCount, metrics.chunks_encrypted);
+  EXPECT_EQ(0, metrics.chunks_reencrypted);
+  EXPECT_EQ(kChunkCount, metrics[Phase::kPreHash].count);
+  for (auto phase : {Phase::kCompress, Phase::kEncrypt, Phase::kXor, Phase::kPostHash}) {
+    EXPECT_EQ(kChunkCount, metrics[phase].count) << PhaseName(phase);
+    EXPECT_LT(0, metrics[phase].total_nanoseconds) << PhaseName(phase);
+    EXPECT_GE(metrics[phase].LatencyPercentile(0.99), metrics[phase].LatencyPercentile(0.5));
+  }
+  EXPECT_EQ(kDataSize, metrics[Phase::kCompress].bytes_in);
+  EXPECT_EQ(kChunkCount, metrics[Phase::kStore].count);
+  EXPECT_EQ(0, metrics[Phase::kFetch].count);
+  // random data doesn't compress
+  EXPECT_LT(0.99, metrics.CompressionRatio());
+  EXPECT_LE(kDataSize, metrics.sequencer_high_water_mark);
+  EXPECT_NE(std::string::npos, metrics.ToString().find("post-hash"));
+
+  ResetMetrics();
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  std::string answer(kDataSize, 0);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kDataSize, 0));
+  EXPECT_EQ(content, answer);
+  metrics = GetMetrics();
+  self_encryptor_->Close();
+  EXPECT_EQ(0, metrics[Phase::kCompress].count);
+  EXPECT_LE(kChunkCount, metrics[Phase::kFetch].count);
+  EXPECT_EQ(metrics[Phase::kFetch].count, metrics[Phase::kDecrypt].count);
+  EXPECT_EQ(metrics[Phase::kFetch].count, metrics[Phase::kDecompress].count);
+  EXPECT_EQ(metrics[Phase::kFetch].count, metrics[Phase::kXor].count);
+  EXPECT_EQ(metrics[Phase::kFetch].count * kMaxChunkSize,
+            metrics[Phase::kDecompress].bytes_out);
+}
+
+TEST_F(MetricsTest, BEH_ReencryptedChunksCounted) {
+  const uint32_t kDataSize(5 * kMaxChunkSize);
+  EXPECT_TRUE(self_encryptor_->Write(RandomString(kDataSize).data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  ResetMetrics();
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_TRUE(self_encryptor_->Write("a", 1, 2 * kMaxChunkSize + 10));
+  self_encryptor_->Close();
+  MetricsSnapshot metrics(GetMetrics());
+  EXPECT_LT(0, metrics.chunks_reencrypted);
+  EXPECT_EQ(metrics.chunks_encrypted, metrics.chunks_reencrypted);
+}
+
+TEST_F(MetricsTest, BEH_CloseAfterOnlyReadingIsFree) {
+  for (uint32_t size : {3 * kMinChunkSize, 5 * kMaxChunkSize + 7}) {
+    self_encryptor_->Close();
+    data_map_ = DataMap();
+    self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+    const std::string content(RandomString(size));
+    EXPECT_TRUE(self_encryptor_->Write(content.data(), size, 0));
+    self_encryptor_->Close();
+    const DataMap kDataMap(data_map_);
+
+    self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+    std::string answer(size, 0);
+    EXPECT_TRUE(self_encryptor_->Read(&answer[0], size, 0));
+    EXPECT_EQ(content, answer);
+    ResetMetrics();
+    self_encryptor_->Close();
+    MetricsSnapshot metrics(GetMetrics());
+    EXPECT_EQ(0, metrics.chunks_encrypted) << size;
+    EXPECT_EQ(0, metrics[Phase::kPreHash].count) << size;
+    EXPECT_EQ(0, metrics[Phase::kStore].count) << size;
+    EXPECT_EQ(kDataMap, data_map_) << size;
+  }
+}
+
+TEST_F(MetricsTest, BEH_ZeroChunkChecksAreCached) {
+  // each of the three chunks starts with '\0's, so has the pre-hash of a chunk of '\0's and is
+  // compared with the zero chunk of its size whenever the file is opened
+  const uint32_t kDataSize(2 * kMaxChunkSize + 5);
+  std::string content(RandomString(kDataSize));
+  for (uint32_t chunk(0); chunk != 3; ++chunk)
+    std::fill_n(content.begin() + chunk * (kDataSize / 3), 64, '\0');
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+  ASSERT_EQ(3, data_map_.chunks.size());
+
+  for (int session(0); session != 2; ++session) {
+    ResetMetrics();
+    self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+    std::string answer(kDataSize, 1);
+    EXPECT_TRUE(self_encryptor_->Read(&answer[0], kDataSize, 0));
+    EXPECT_TRUE(content == answer);
+    self_encryptor_->Close();
+    // the first session builds the zero chunks of the chunks' sizes; the second finds them cached
+    if (session == 1)
+      EXPECT_EQ(0, GetMetrics()[Phase::kCompress].count);
+  }
+}
+
+TEST_F(MetricsTest, BEH_AppendOnlyTouchesKeyDependencies) {
+  const uint32_t kDataSize(10 * kMaxChunkSize + 7);
+  EXPECT_TRUE(self_encryptor_->Write(RandomString(kDataSize).data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  ResetMetrics();
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_TRUE(self_encryptor_->Write(RandomString(100).data(), 100, kDataSize));
+  self_encryptor_->Close();
+  // the old last two chunks change, and so do chunks 0 and 1, whose keys come from them
+  MetricsSnapshot metrics(GetMetrics());
+  EXPECT_EQ(4, metrics[Phase::kFetch].count);
+  EXPECT_EQ(4, metrics.chunks_encrypted);
+  EXPECT_EQ(4, metrics[Phase::kStore].count);
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,85 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/page_allocator.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+class PageAllocatorTest : public EncryptTestBase, public testing::TestWithParam<PagePolicy> {
+ protected:
+  virtual void SetUp() override {
+    SetPagePolicy(GetParam());
+    self_encryptor_->Close();
+    self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  }
+  virtual void TearDown() override {
+    self_encryptor_->Close();
+    SetPagePolicy(PagePolicy::kStandard);
+  }
+};
+
+TEST_P(PageAllocatorTest, BEH_AllocateSmallAndLarge) {
+  const PageAllocator<byte> allocator(GetParam());
+  for (size_t size : {size_t(1), size_t(4096), HugePageSize() - 1, HugePageSize(),
+                      HugePageSize() + 1, 3 * HugePageSize() + 17}) {
+    std::vector<byte, PageAllocator<byte>> buffer(size, 0, allocator);
+    EXPECT_TRUE(std::all_of(std::begin(buffer), std::end(buffer), [](byte b) { return b == 0; }));
+    std::fill(std::begin(buffer), std::end(buffer), static_cast<byte>(size));
+    buffer.resize(size + HugePageSize());
+    EXPECT_EQ(static_cast<byte>(size), buffer.front());
+    EXPECT_EQ(static_cast<byte>(size), buffer[size - 1]);
+    EXPECT_EQ(0, buffer.back());
+  }
+}
+
+TEST_P(PageAllocatorTest, BEH_SelfEncryptorRoundTrip) {
+  const uint32_t kDataSize(5 * kMaxChunkSize + 123);
+  const std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  std::string result(kDataSize, 0);
+  EXPECT_TRUE(self_encryptor_->Read(&result[0], kDataSize, 0));
+  EXPECT_EQ(content, result);
+}
+
+INSTANTIATE_TEST_CASE_P(Policies, PageAllocatorTest,
+                        testing::Values(PagePolicy::kStandard, PagePolicy::kTransparentHuge,
+                                        PagePolicy::kExplicitHuge));
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,157 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/make_unique.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/config.h"
+#include "maidsafe/encrypt/restore.h"
+#include "maidsafe/encrypt/self_encryptor.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+class RestoreTest : public EncryptTestBase, public testing::Test {
+ protected:
+  void WriteFile(const std::string& content) {
+    EXPECT_TRUE(self_encryptor_->Write(content.data(), static_cast<uint32_t>(content.size()), 0));
+    self_encryptor_->Close();
+  }
+
+  std::string RestoreFile(const RestoreOptions& options = RestoreOptions()) {
+    std::string restored;
+    Restore(data_map_, get_from_store_, [&](const char* data, uint32_t length, uint64_t position) {
+      EXPECT_EQ(restored.size(), position);
+      restored.append(data, length);
+    }, options);
+    return restored;
+  }
+};
+
+TEST_F(RestoreTest, BEH_RestoreSmallAndChunkedFiles) {
+  for (uint32_t size : {0U, 10U, 3 * kMinChunkSize - 1, 3 * kMinChunkSize, kMaxChunkSize + 1,
+                        7 * kMaxChunkSize + 5}) {
+    self_encryptor_->Close();
+    data_map_ = DataMap();
+    self_encryptor_ =
+        maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+    const std::string content(RandomString(size));
+    WriteFile(content);
+    EXPECT_EQ(content, RestoreFile()) << size;
+  }
+}
+
+TEST_F(RestoreTest, BEH_RestoreSparseFile) {
+  const std::string kData(RandomString(100));
+  EXPECT_TRUE(self_encryptor_->Write(kData.data(), 100, 10 * kMaxChunkSize));
+  self_encryptor_->Close();
+  std::string content(10 * kMaxChunkSize, 0);
+  content += kData;
+  EXPECT_EQ(content, RestoreFile());
+}
+
+TEST_F(RestoreTest, BEH_SlowSinkAndStoreWithMinimalQueues) {
+  const std::string content(RandomString(12 * kMaxChunkSize));
+  WriteFile(content);
+  auto slow_store([this](const std::string& name) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(RandomUint32() % 5));
+    return get_from_store_(name);
+  });
+  RestoreOptions options;
+  options.fetch_threads = 3;
+  options.fetched_queue_depth = 1;
+  options.decrypt_threads = 2;
+  options.decrypted_queue_depth = 1;
+  std::string restored;
+  Restore(data_map_, slow_store, [&](const char* data, uint32_t length, uint64_t) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(RandomUint32() % 5));
+    restored.append(data, length);
+  }, options);
+  EXPECT_EQ(content, restored);
+}
+
+TEST_F(RestoreTest, BEH_StalledFetchBoundsHeldChunks) {
+  const std::string content(RandomString(20 * kMaxChunkSize));
+  WriteFile(content);
+  const std::string kFirstChunk(std::begin(data_map_.chunks[0].hash),
+                                std::end(data_map_.chunks[0].hash));
+  // Chunks whose fetch has started but which haven't yet been passed to the sink.
+  std::atomic<uint32_t> started(0), passed(0), peak_held(0);
+  auto stalling_store([&](const std::string& name) {
+    auto held(++started - passed);
+    auto peak(peak_held.load());
+    while (held > peak && !peak_held.compare_exchange_weak(peak, held)) {
+    }
+    if (name == kFirstChunk)
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    return get_from_store_(name);
+  });
+  RestoreOptions options;
+  options.fetch_threads = 2;
+  options.fetched_queue_depth = 1;
+  options.decrypt_threads = 1;
+  options.decrypted_queue_depth = 1;
+  std::string restored;
+  Restore(data_map_, stalling_store, [&](const char* data, uint32_t length, uint64_t) {
+    restored.append(data, length);
+    ++passed;
+  }, options);
+  EXPECT_EQ(content, restored);
+  EXPECT_LE(peak_held, options.fetch_threads + options.fetched_queue_depth +
+                           options.decrypt_threads + options.decrypted_queue_depth);
+}
+
+TEST_F(RestoreTest, BEH_ErrorsStopThePipeline) {
+  WriteFile(RandomString(20 * kMaxChunkSize));
+  std::atomic<int> fetches(0);
+  auto failing_store([&](const std::string& name) {
+    if (++fetches == 5)
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::no_such_element));
+    return get_from_store_(name);
+  });
+  EXPECT_THROW(Restore(data_map_, failing_store, [](const char*, uint32_t, uint64_t) {}),
+               common_error);
+
+  uint32_t calls(0);
+  EXPECT_THROW(Restore(data_map_, get_from_store_,
+                       [&](const char*, uint32_t, uint64_t) {
+                         if (++calls == 3)
+                           BOOST_THROW_EXCEPTION(MakeError(CommonErrors::invalid_argument));
+                       }),
+               common_error);
+  EXPECT_EQ(3, calls);
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -17,6 +17,7 @@
     use of the MaidSafe Software.                                                                 */
 
 #include <thread>
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <string>
@@ -28,6 +29,7 @@
 #include "maidsafe/common/utils.h"
 #include "maidsafe/common/data_buffer.h"
 
+#include "maidsafe/encrypt/chunk_crypto.h"
 #include "maidsafe/encrypt/self_encryptor.h"
 #include "maidsafe/encrypt/data_map.h"
 #include "maidsafe/encrypt/config.h"
@@ -72,6 +74,22 @@ class PrivateSelfEncryptorTest : public EncryptTestBase, public testing::Test {
   }
 
   void SetEncryptorSize(uint64_t size) { self_encryptor_->file_size_ = size; }
+
+  const ChunkKeys& GetPadIvKey(uint32_t chunk_number) {
+    return *self_encryptor_->GetPadIvKey(chunk_number);
+  }
+
+  bool InSmallFileMode() const { return self_encryptor_->small_file_mode_; }
+
+  uint64_t SequencerSize() const { return self_encryptor_->sequencer_.size(); }
+
+  void RollBack() { self_encryptor_->RollBack(); }
+
+  size_t CachedPadIvKeys() const {
+    return std::count_if(std::begin(self_encryptor_->chunk_keys_),
+                         std::end(self_encryptor_->chunk_keys_),
+                         [](const std::shared_ptr<const ChunkKeys>& keys) { return !!keys; });
+  }
 };
 
 TEST_F(PrivateSelfEncryptorTest, BEH_HelpersSmallfileContentOnly) {
@@ -219,6 +237,116 @@ TEST_F(PrivateSelfEncryptorTest, BEH_HelpersEqual5MaxChunks) {
   EXPECT_EQ(GetStartEndPositions(4).first, 4 * kMaxChunkSize);
   EXPECT_EQ(GetStartEndPositions(4).second, 5 * kMaxChunkSize);
 }
+
+TEST_F(PrivateSelfEncryptorTest, BEH_PadIvKeyCachedUntilPreHashChanges) {
+  const uint32_t kDataSize(6 * kMaxChunkSize);
+  std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  // nothing is decrypted until it's accessed
+  EXPECT_EQ(0, CachedPadIvKeys());
+  const ChunkKeys* keys(&GetPadIvKey(4));
+  EXPECT_EQ(keys, &GetPadIvKey(4));
+  EXPECT_EQ(1, CachedPadIvKeys());
+  const auto kOldPad(GetPadIvKey(3).pad);
+
+  // changing chunk 2 changes its pre-hash, which feeds the keys of chunks 2, 3 and 4
+  content[2 * kMaxChunkSize + 5] ^= 1;
+  EXPECT_TRUE(self_encryptor_->Write(&content[2 * kMaxChunkSize + 5], 1, 2 * kMaxChunkSize + 5));
+  self_encryptor_->Close();
+  EXPECT_NE(kOldPad, GetPadIvKey(3).pad);
+  for (uint32_t chunk(0); chunk != GetNumChunks(); ++chunk) {
+    ChunkKeys expected;
+    DerivePadIvKey(data_map_.chunks[chunk].pre_hash,
+                   data_map_.chunks[GetPreviousChunkNumber(chunk)].pre_hash,
+                   data_map_.chunks[GetPreviousChunkNumber(GetPreviousChunkNumber(chunk))].pre_hash,
+                   expected);
+    EXPECT_EQ(expected.key, GetPadIvKey(chunk).key) << chunk;
+    EXPECT_EQ(expected.iv, GetPadIvKey(chunk).iv) << chunk;
+    EXPECT_EQ(expected.pad, GetPadIvKey(chunk).pad) << chunk;
+  }
+
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  std::string result(kDataSize, 0);
+  EXPECT_TRUE(self_encryptor_->Read(&result[0], kDataSize, 0));
+  EXPECT_EQ(content, result);
+}
+
+TEST_F(PrivateSelfEncryptorTest, BEH_SmallFileBypassesSequencer) {
+  const std::string kContent(RandomString(3 * kMinChunkSize - 1));
+  EXPECT_TRUE(self_encryptor_->Write(kContent.data(), 100, 0));
+  EXPECT_TRUE(self_encryptor_->Write(kContent.data() + 200,
+                                     static_cast<uint32_t>(kContent.size() - 200), 200));
+  EXPECT_TRUE(InSmallFileMode());
+  EXPECT_EQ(0, SequencerSize());
+  std::string expected(kContent);
+  std::fill(std::begin(expected) + 100, std::begin(expected) + 200, 0);
+  std::string result(expected.size(), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&result[0], static_cast<uint32_t>(result.size()), 0));
+  EXPECT_EQ(expected, result);
+  self_encryptor_->Close();
+  EXPECT_TRUE(data_map_.chunks.empty());
+  EXPECT_EQ(expected, std::string(std::begin(data_map_.content), std::end(data_map_.content)));
+
+  // reopened, shrunk then grown past the threshold
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_TRUE(InSmallFileMode());
+  EXPECT_TRUE(self_encryptor_->Truncate(10));
+  EXPECT_TRUE(self_encryptor_->Truncate(4 * kMinChunkSize));
+  expected = expected.substr(0, 10) + std::string(4 * kMinChunkSize - 10, 0);
+  result.assign(expected.size(), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&result[0], static_cast<uint32_t>(result.size()), 0));
+  EXPECT_EQ(expected, result);
+  EXPECT_FALSE(InSmallFileMode());
+  EXPECT_EQ(4 * kMinChunkSize, SequencerSize());
+  self_encryptor_->Close();
+  EXPECT_EQ(3, data_map_.chunks.size());
+
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_FALSE(InSmallFileMode());
+  result.assign(expected.size(), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&result[0], static_cast<uint32_t>(result.size()), 0));
+  EXPECT_EQ(expected, result);
+}
+
+TEST_F(PrivateSelfEncryptorTest, BEH_RollBackRestoresOpenedDataMap) {
+  const uint32_t kDataSize(5 * kMaxChunkSize + 7);
+  const std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+  const DataMap kOpened(data_map_);
+
+  // changes some chunks, drops one and adds a new last chunk
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_TRUE(self_encryptor_->Write("a", 1, kMaxChunkSize + 3));
+  EXPECT_TRUE(self_encryptor_->Truncate(3 * kMaxChunkSize + kMinChunkSize / 2));
+  self_encryptor_->Close();
+  EXPECT_NE(kOpened, data_map_);
+  RollBack();
+  EXPECT_EQ(kOpened, data_map_);
+
+  // shrinks to content only
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_TRUE(self_encryptor_->Truncate(100));
+  self_encryptor_->Close();
+  EXPECT_TRUE(data_map_.chunks.empty());
+  RollBack();
+  EXPECT_EQ(kOpened, data_map_);
+
+  // grows from content only
+  data_map_.chunks.clear();
+  data_map_.content.assign(std::begin(content), std::begin(content) + 100);
+  const DataMap kOpenedSmall(data_map_);
+  self_encryptor_.reset(new SelfEncryptor(data_map_, local_store_, get_from_store_));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+  EXPECT_FALSE(data_map_.chunks.empty());
+  RollBack();
+  EXPECT_EQ(kOpenedSmall, data_map_);
+}
+
 }  // namespace test
 
 }  // namespace encrypt
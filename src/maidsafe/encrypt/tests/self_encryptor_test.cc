@@ -18,8 +18,12 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdlib>
+#include <map>
+#include <mutex>
 #include <random>
+#include <set>
 #include <string>
 #include <thread>
 
@@ -46,6 +50,7 @@
 #include "maidsafe/common/test.h"
 #include "maidsafe/common/utils.h"
 
+#include "maidsafe/encrypt/batch_encryptor.h"
 #include "maidsafe/encrypt/self_encryptor.h"
 #include "maidsafe/encrypt/data_map_encryptor.h"
 #include "maidsafe/encrypt/config.h"
@@ -1277,6 +1282,215 @@ TEST_F(BasicTest, BEH_TruncateIncreaseDecrease) {
   }
 }
 
+TEST_F(BasicTest, BEH_TruncateDecreaseThenIncreaseReadsZeros) {
+  const uint32_t kDataSize(6 * kMaxChunkSize + 123);
+  const std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  // several truncations between accesses are applied together; none should expose old data
+  const uint32_t kTruncatedSize(2 * kMaxChunkSize + 5000);
+  const uint32_t kFinalSize(4 * kMaxChunkSize + 77);
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  EXPECT_TRUE(self_encryptor_->Truncate(5 * kMaxChunkSize));
+  EXPECT_TRUE(self_encryptor_->Truncate(kTruncatedSize));
+  EXPECT_TRUE(self_encryptor_->Truncate(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Truncate(kFinalSize));
+  EXPECT_EQ(kFinalSize, self_encryptor_->size());
+
+  const std::string expected(content.substr(0, kTruncatedSize) +
+                             std::string(kFinalSize - kTruncatedSize, 0));
+  std::string answer(kFinalSize, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kFinalSize, 0));
+  EXPECT_EQ(expected, answer);
+  self_encryptor_->Close();
+  EXPECT_EQ(kFinalSize, data_map_.size());
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  answer.assign(kFinalSize, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kFinalSize, 0));
+  EXPECT_EQ(expected, answer);
+}
+
+TEST_F(BasicTest, BEH_RewriteLastChunkAfterReopen) {
+  // the first two chunks are encrypted using the last two chunks' pre-hashes
+  const uint32_t kDataSize(5 * kMaxChunkSize + 123);
+  std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  const std::string kRewrite(RandomString(10));
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  EXPECT_TRUE(self_encryptor_->Write(kRewrite.data(), 10, kDataSize - 50));
+  content.replace(kDataSize - 50, 10, kRewrite);
+  self_encryptor_->Close();
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  std::string answer(kDataSize, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kDataSize, 0));
+  EXPECT_EQ(content, answer);
+}
+
+TEST_F(BasicTest, BEH_AppendAfterReopen) {
+  // covers growing from three equal chunks, from whole chunks and from a shortened penultimate
+  for (uint32_t size : {3 * kMinChunkSize, 3 * kMaxChunkSize - 5, 3 * kMaxChunkSize,
+                        3 * kMaxChunkSize + 7, 5 * kMaxChunkSize + kMinChunkSize + 1}) {
+    for (uint32_t extra : {1U, kMinChunkSize, kMaxChunkSize + 3}) {
+      self_encryptor_->Close();
+      data_map_ = DataMap();
+      self_encryptor_ =
+          maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+      std::string content(content_.substr(0, size));
+      EXPECT_TRUE(self_encryptor_->Write(content.data(), size, 0));
+      self_encryptor_->Close();
+
+      self_encryptor_ =
+          maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+      const std::string kAppended(RandomString(extra));
+      EXPECT_TRUE(self_encryptor_->Write(kAppended.data(), extra, size));
+      content += kAppended;
+      self_encryptor_->Close();
+      // the same as encrypting the whole file afresh
+      EXPECT_EQ(EncryptFiles(std::vector<BatchFile>(1, BatchFile(content.data(), content.size())),
+                             local_store_).front(),
+                data_map_) << size << " + " << extra;
+
+      self_encryptor_ =
+          maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+      std::string answer(content.size(), 1);
+      EXPECT_TRUE(self_encryptor_->Read(&answer[0], static_cast<uint32_t>(answer.size()), 0));
+      EXPECT_TRUE(content == answer) << size << " + " << extra;
+    }
+  }
+}
+
+TEST_F(BasicTest, BEH_WriteAcrossChunkTableCapacity) {
+  // the write's window holds remote chunks being loaded and new chunks beyond the chunk table's
+  // capacity, which must be added before the loading starts
+  const uint32_t kDataSize(10 * kMaxChunkSize);
+  std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  const std::string kWrite(RandomString(10 * kMaxChunkSize));
+  const uint64_t kPosition(5 * kMaxChunkSize);
+  EXPECT_TRUE(self_encryptor_->Write(kWrite.data(), static_cast<uint32_t>(kWrite.size()),
+                                     kPosition));
+  content.replace(kPosition, std::string::npos, kWrite);
+  self_encryptor_->Close();
+  EXPECT_EQ(content.size(), data_map_.size());
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  std::string answer(content.size(), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], static_cast<uint32_t>(answer.size()), 0));
+  EXPECT_TRUE(content == answer);
+}
+
+TEST_F(BasicTest, BEH_CloseAsyncServesReads) {
+  const uint32_t kDataSize(8 * kMaxChunkSize + 5);
+  std::string content(content_.substr(0, kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  // rewrite part of one chunk and append, leaving most of the file remote
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  const std::string kRewrite(RandomString(100)), kAppended(RandomString(kMaxChunkSize / 2));
+  EXPECT_TRUE(self_encryptor_->Write(kRewrite.data(), 100, 4 * kMaxChunkSize - 50));
+  EXPECT_TRUE(self_encryptor_->Write(kAppended.data(), kMaxChunkSize / 2, kDataSize));
+  content.replace(4 * kMaxChunkSize - 50, 100, kRewrite);
+  content += kAppended;
+  auto closed(self_encryptor_->CloseAsync());
+
+  std::string answer(content.size(), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], static_cast<uint32_t>(answer.size()), 0));
+  EXPECT_TRUE(content == answer);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], 1000, 2 * kMaxChunkSize - 500));
+  EXPECT_TRUE(content.substr(2 * kMaxChunkSize - 500, 1000) == answer.substr(0, 1000));
+  EXPECT_THROW(self_encryptor_->Write("a", 1, 0), encrypt_error);
+  EXPECT_THROW(self_encryptor_->Truncate(0), encrypt_error);
+
+  DataMap data_map(closed.get());
+  EXPECT_EQ(data_map_, data_map);
+  EXPECT_EQ(content.size(), data_map.size());
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], 1000, content.size() - 1000));
+  EXPECT_TRUE(content.substr(content.size() - 1000) == answer.substr(0, 1000));
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  std::fill(std::begin(answer), std::end(answer), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], static_cast<uint32_t>(answer.size()), 0));
+  EXPECT_TRUE(content == answer);
+
+  // small files are finished before CloseAsync returns
+  self_encryptor_->Close();
+  data_map_ = DataMap();
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), 100, 0));
+  closed = self_encryptor_->CloseAsync();
+  EXPECT_EQ(100, closed.get().content.size());
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], 100, 0));
+  EXPECT_TRUE(content.substr(0, 100) == answer.substr(0, 100));
+}
+
+TEST_F(BasicTest, BEH_ScatterReadAroundModifiedChunks) {
+  // large reads decrypt whole remote chunks in parallel; the rest goes through the sequencer
+  const uint32_t kDataSize(10 * kMaxChunkSize + 321);
+  std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  const std::string kRewrite(RandomString(100));
+  EXPECT_TRUE(self_encryptor_->Write(kRewrite.data(), 100, 5 * kMaxChunkSize + 10));
+  content.replace(5 * kMaxChunkSize + 10, 100, kRewrite);
+
+  // starts and ends part way through chunks, with a modified chunk in the middle
+  const uint64_t kPosition(kMaxChunkSize / 2);
+  const uint32_t kLength(8 * kMaxChunkSize);
+  std::string answer(kLength, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kLength, kPosition));
+  EXPECT_EQ(content.substr(kPosition, kLength), answer);
+
+  answer.assign(kDataSize, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kDataSize, 0));
+  EXPECT_EQ(content, answer);
+  self_encryptor_->Close();
+
+  self_encryptor_ = maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, get_from_store_);
+  answer.assign(kDataSize, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kDataSize, 0));
+  EXPECT_EQ(content, answer);
+}
+
+TEST_F(BasicTest, BEH_UnalignedScatterReadFetchesEachChunkOnce) {
+  const uint32_t kDataSize(10 * kMaxChunkSize + 321);
+  const std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  std::mutex mutex;
+  std::map<std::string, int> fetch_counts;
+  auto counting_get_from_store([&](const std::string& name) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++fetch_counts[name];
+    }
+    return get_from_store_(name);
+  });
+  self_encryptor_ =
+      maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, counting_get_from_store);
+
+  // chunks 1 to 5 are scattered; the partial chunks 0 and 6 mustn't read ahead into them
+  const uint64_t kPosition(kMaxChunkSize / 2);
+  const uint32_t kLength(6 * kMaxChunkSize);
+  std::string answer(kLength, 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], kLength, kPosition));
+  EXPECT_TRUE(content.substr(kPosition, kLength) == answer);
+  EXPECT_LE(7U, fetch_counts.size());
+  for (const auto& fetch_count : fetch_counts)
+    EXPECT_EQ(1, fetch_count.second);
+}
+
 TEST_F(BasicTest, FUNC_RandomAccess) {
   uint32_t chunk_size(1024);
   std::vector<uint32_t> num_of_tries;
@@ -1428,6 +1642,95 @@ TEST_F(BasicTest, FUNC_ReadAfterClose) {
   }
 }
 
+TEST_F(BasicTest, BEH_SparseWrite) {
+  const std::string content(RandomString(100));
+  const uint64_t kPosition(10 * static_cast<uint64_t>(kMaxChunkSize) + 5);
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), static_cast<uint32_t>(content.size()),
+                                     kPosition));
+  self_encryptor_->Close();
+  ASSERT_EQ(kPosition + content.size(), data_map_.size());
+
+  // every chunk in the leading hole converges on the same stored chunk
+  std::set<ByteVector> hashes;
+  for (const auto& chunk : data_map_.chunks)
+    hashes.insert(chunk.hash);
+  EXPECT_GE(3U, hashes.size());
+
+  // only the chunks holding data need to be fetched to read the file back
+  int fetch_count(0);
+  auto counting_get_from_store([&](const std::string& name) {
+    ++fetch_count;
+    return get_from_store_(name);
+  });
+  self_encryptor_ =
+      maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, counting_get_from_store);
+  std::string answer(static_cast<size_t>(data_map_.size()), 1);
+  EXPECT_TRUE(self_encryptor_->Read(&answer[0], static_cast<uint32_t>(answer.size()), 0));
+  EXPECT_EQ(std::string(static_cast<size_t>(kPosition), 0),
+            answer.substr(0, static_cast<size_t>(kPosition)));
+  EXPECT_EQ(content, answer.substr(static_cast<size_t>(kPosition)));
+  EXPECT_GE(3, fetch_count);
+}
+
+TEST_F(BasicTest, BEH_ConcurrentReads) {
+  const uint32_t kDataSize(8 * kMaxChunkSize + 123);
+  const std::string content(RandomString(kDataSize));
+  EXPECT_TRUE(self_encryptor_->Write(content.data(), kDataSize, 0));
+  self_encryptor_->Close();
+
+  // slowed down so that the readers overlap
+  std::mutex mutex;
+  std::map<std::string, int> fetch_counts;
+  auto counting_get_from_store([&](const std::string& name) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++fetch_counts[name];
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return get_from_store_(name);
+  });
+  self_encryptor_ =
+      maidsafe::make_unique<SelfEncryptor>(data_map_, local_store_, counting_get_from_store);
+
+  // every thread reads the same part of chunk 4, which loads chunks 4 and 5 once between them
+  const size_t kThreadCount(8);
+  const uint64_t kPosition(4 * kMaxChunkSize + 10);
+  std::vector<std::string> answers(kThreadCount, std::string(100, 0));
+  std::vector<std::thread> threads;
+  for (size_t i(0); i != kThreadCount; ++i) {
+    threads.emplace_back([&, i] {
+      EXPECT_TRUE(self_encryptor_->Read(&answers[i][0], 100, kPosition));
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  for (const auto& answer : answers)
+    EXPECT_EQ(content.substr(kPosition, 100), answer);
+  ASSERT_EQ(2, fetch_counts.size());
+  for (const auto& fetch_count : fetch_counts)
+    EXPECT_EQ(1, fetch_count.second);
+
+  // threads reading different ranges, some whole chunks and some straddling chunks
+  threads.clear();
+  std::vector<std::string> ranges(kThreadCount);
+  for (size_t i(0); i != kThreadCount; ++i) {
+    threads.emplace_back([&, i] {
+      for (int read(0); read != 4; ++read) {
+        uint32_t position((static_cast<uint32_t>(i) + read) % 8 * kMaxChunkSize +
+                          (read % 2) * (kMaxChunkSize / 2));
+        uint32_t length(std::min(kMaxChunkSize + 77, kDataSize - position));
+        std::string answer(length, 0);
+        EXPECT_TRUE(self_encryptor_->Read(&answer[0], length, position));
+        EXPECT_TRUE(content.substr(position, length) == answer) << i << ' ' << read;
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  self_encryptor_->Close();
+  EXPECT_EQ(kDataSize, data_map_.size());
+}
+
 
 }  // namespace test
 
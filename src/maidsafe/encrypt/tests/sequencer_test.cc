@@ -0,0 +1,93 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <cstdint>
+#include <string>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/sequencer.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+namespace {
+
+const byte* Bytes(const std::string& str) { return reinterpret_cast<const byte*>(str.data()); }
+
+byte* Bytes(std::string& str) { return reinterpret_cast<byte*>(&str[0]); }
+
+}  // unnamed namespace
+
+TEST(SequencerTest, BEH_WriteReadAcrossSegments) {
+  Sequencer sequencer;
+  const uint32_t kSegmentSize(sequencer.segment_size());
+  const std::string kContent(RandomString(2 * kSegmentSize + 100));
+  const uint64_t kPosition(kSegmentSize - 50);
+
+  sequencer.Resize(kPosition + kContent.size());
+  EXPECT_EQ(kPosition + kContent.size(), sequencer.size());
+  sequencer.Write(Bytes(kContent), static_cast<uint32_t>(kContent.size()), kPosition);
+
+  std::string result(kContent.size(), 1);
+  sequencer.Read(Bytes(result), static_cast<uint32_t>(result.size()), kPosition);
+  EXPECT_EQ(kContent, result);
+
+  std::string leading(static_cast<size_t>(kPosition), 1);
+  sequencer.Read(Bytes(leading), static_cast<uint32_t>(leading.size()), 0);
+  EXPECT_EQ(std::string(static_cast<size_t>(kPosition), 0), leading);
+}
+
+TEST(SequencerTest, BEH_AppendInSmallPieces) {
+  Sequencer sequencer;
+  const uint32_t kPieceSize(4096);
+  const std::string kContent(RandomString(3 * sequencer.segment_size() + kPieceSize));
+  for (uint32_t i(0); i < kContent.size(); i += kPieceSize) {
+    sequencer.Resize(i + kPieceSize);
+    sequencer.Write(Bytes(kContent) + i, kPieceSize, i);
+  }
+  std::string result(kContent.size(), 1);
+  sequencer.Read(Bytes(result), static_cast<uint32_t>(result.size()), 0);
+  EXPECT_EQ(kContent, result);
+}
+
+TEST(SequencerTest, BEH_ShrinkThenGrowReadsZeros) {
+  Sequencer sequencer;
+  const uint32_t kSize(sequencer.segment_size() + 1000);
+  const std::string kContent(RandomString(kSize));
+  sequencer.Resize(kSize);
+  sequencer.Write(Bytes(kContent), kSize, 0);
+
+  const uint32_t kShrunkSize(sequencer.segment_size() - 10);
+  sequencer.Resize(kShrunkSize);
+  sequencer.Resize(kSize);
+  std::string result(kSize, 1);
+  sequencer.Read(Bytes(result), kSize, 0);
+  EXPECT_EQ(kContent.substr(0, kShrunkSize), result.substr(0, kShrunkSize));
+  EXPECT_EQ(std::string(kSize - kShrunkSize, 0), result.substr(kShrunkSize));
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
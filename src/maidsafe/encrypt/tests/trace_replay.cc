@@ -0,0 +1,80 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+// Replays a trace (see maidsafe/encrypt/trace.h) and prints the latency of each type of operation
+// along with the total wall and CPU time, e.g.
+//   trace_replay_encrypt src/maidsafe/encrypt/tests/traces/pdb_build.trace --verify
+
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "maidsafe/common/data_buffer.h"
+#include "maidsafe/common/error.h"
+
+#include "maidsafe/encrypt/metrics.h"
+#include "maidsafe/encrypt/trace.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+int Replay(const char* path, bool verify) {
+  std::ifstream input(path);
+  if (!input) {
+    std::cerr << "Failed to open " << path << '\n';
+    return 1;
+  }
+  auto trace(ReadTrace(input));
+
+  DataBuffer buffer(MemoryUsage(uint64_t(1) << 30), DiskUsage(uint64_t(16) << 30),
+                    [](const DataBuffer::KeyType&, const NonEmptyString&) {
+                      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::cannot_exceed_limit));
+                    });
+  auto get_from_store([&buffer](const std::string& name) {
+    return buffer.Get(DataBuffer::KeyType(Identity(name), DataTypeId(0)));
+  });
+  ResetMetrics();
+  auto result(ReplayTrace(trace, buffer, get_from_store, verify));
+  std::cout << "Replayed " << trace.size() << " operations from " << path << "\n\n"
+            << result.ToString() << '\n' << GetMetrics().ToString();
+  return result.failed_reads == 0 ? 0 : 2;
+}
+
+}  // unnamed namespace
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3 || (argc == 3 && std::strcmp(argv[2], "--verify") != 0)) {
+    std::cerr << "Usage: " << argv[0] << " <trace file> [--verify]\n";
+    return 1;
+  }
+  try {
+    return maidsafe::encrypt::Replay(argv[1], argc == 3);
+  } catch (const std::exception& e) {
+    std::cerr << "Replay failed: " << e.what() << '\n';
+    return 1;
+  }
+}
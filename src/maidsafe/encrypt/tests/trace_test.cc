@@ -0,0 +1,113 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem/path.hpp"
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+
+#include "maidsafe/encrypt/trace.h"
+#include "maidsafe/encrypt/tests/encrypt_test_base.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace test {
+
+class TraceTest : public EncryptTestBase, public testing::Test {
+ protected:
+  virtual void TearDown() override { self_encryptor_->Close(); }
+};
+
+TEST_F(TraceTest, BEH_RecordAndReadBack) {
+  const std::string content(RandomString(3 * kMaxChunkSize));
+  std::vector<char> decrypted(100);
+  std::stringstream stream;
+  {
+    DataMap data_map;
+    TracingSelfEncryptor recorder(data_map, local_store_, get_from_store_, stream);
+    EXPECT_TRUE(recorder.Write(content.data(), static_cast<uint32_t>(content.size()), 0));
+    EXPECT_TRUE(recorder.Flush());
+    EXPECT_TRUE(recorder.Truncate(2 * kMaxChunkSize + 1));
+    EXPECT_TRUE(recorder.Read(decrypted.data(), 100, kMaxChunkSize - 50));
+    EXPECT_EQ(content.substr(kMaxChunkSize - 50, 100),
+              std::string(decrypted.data(), decrypted.size()));
+    recorder.Close();
+    EXPECT_EQ(2 * kMaxChunkSize + 1, data_map.size());
+  }
+
+  const std::vector<TraceOperation> kExpected{
+      TraceOperation(TraceOperation::Type::kWrite, 0, 3 * kMaxChunkSize),
+      TraceOperation(TraceOperation::Type::kFlush),
+      TraceOperation(TraceOperation::Type::kTruncate, 2 * kMaxChunkSize + 1),
+      TraceOperation(TraceOperation::Type::kRead, kMaxChunkSize - 50, 100),
+      TraceOperation(TraceOperation::Type::kClose)};
+  EXPECT_EQ(kExpected, ReadTrace(stream));
+}
+
+TEST_F(TraceTest, BEH_ReadTraceRejectsMalformedLines) {
+  std::istringstream valid("# comment\n\nW 10 20\n  R 0 5\nT 7\nF\nC\n");
+  EXPECT_EQ(5, ReadTrace(valid).size());
+  for (std::string line : {"X", "W 10", "R a b", "T", "F 1", "W 1 2 3"}) {
+    std::istringstream malformed("F\n" + line + "\n");
+    EXPECT_THROW(ReadTrace(malformed), common_error) << line;
+  }
+}
+
+TEST_F(TraceTest, BEH_ReplayVerifiesReads) {
+  std::istringstream input(
+      "W 0 5000\nT 3000\nW 4000 1000\nR 0 5000\nC\nR 2000 3000\nW 20000 4096\nR 10000 14096\n"
+      "T 100\nC\nR 0 100\nR 50 51\n");
+  const auto kTrace(ReadTrace(input));
+  auto result(ReplayTrace(kTrace, local_store_, get_from_store_, true));
+  // only the read past the end of the file fails
+  EXPECT_EQ(1, result.failed_reads);
+  EXPECT_EQ(3, result[TraceOperation::Type::kWrite].count);
+  EXPECT_EQ(5, result[TraceOperation::Type::kRead].count);
+  EXPECT_EQ(2, result[TraceOperation::Type::kClose].count);
+  EXPECT_EQ(10096, result.bytes_written);
+  EXPECT_LE(result[TraceOperation::Type::kRead].p50, result[TraceOperation::Type::kRead].max);
+  EXPECT_LT(0, result.wall_time.count());
+}
+
+// Accesses made to a pdb file while building MaidSafe-PKI using VS2010.
+TEST_F(TraceTest, FUNC_ReplayPdbBuildTrace) {
+  std::ifstream input(
+      (boost::filesystem::path(__FILE__).parent_path() / "traces" / "pdb_build.trace").string());
+  ASSERT_TRUE(input.good());
+  const auto kTrace(ReadTrace(input));
+  ASSERT_FALSE(kTrace.empty());
+  auto result(ReplayTrace(kTrace, local_store_, get_from_store_, true));
+  EXPECT_EQ(0, result.failed_reads);
+  LOG(kInfo) << '\n' << result.ToString();
+}
+
+}  // namespace test
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
@@ -0,0 +1,293 @@
+/*  Copyright 2014 MaidSafe.net limited
+
+    This MaidSafe Software is licensed to you under (1) the MaidSafe.net Commercial License,
+    version 1.0 or later, or (2) The General Public License (GPL), version 3, depending on which
+    licence you accepted on initial access to the Software (the "Licences").
+
+    By contributing code to the MaidSafe Software, or to this project generally, you agree to be
+    bound by the terms of the MaidSafe Contributor Agreement, version 1.0, found in the root
+    directory of this project at LICENSE, COPYING and CONTRIBUTOR respectively and also
+    available at: http://www.maidsafe.net/licenses
+
+    Unless required by applicable law or agreed to in writing, the MaidSafe Software distributed
+    under the GPL Licence is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS
+    OF ANY KIND, either express or implied.
+
+    See the Licences for the specific language governing permissions and limitations relating to
+    use of the MaidSafe Software.                                                                 */
+
+#include "maidsafe/encrypt/trace.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <utility>
+
+#include "maidsafe/common/error.h"
+#include "maidsafe/common/log.h"
+#include "maidsafe/common/utils.h"
+
+namespace maidsafe {
+
+namespace encrypt {
+
+namespace {
+
+const std::array<TraceOperation::Type, 5> kTypes{
+    {TraceOperation::Type::kWrite, TraceOperation::Type::kRead, TraceOperation::Type::kTruncate,
+     TraceOperation::Type::kFlush, TraceOperation::Type::kClose}};
+
+const char* TypeName(TraceOperation::Type type) {
+  switch (type) {
+    case TraceOperation::Type::kWrite:
+      return "write";
+    case TraceOperation::Type::kRead:
+      return "read";
+    case TraceOperation::Type::kTruncate:
+      return "truncate";
+    case TraceOperation::Type::kFlush:
+      return "flush";
+    case TraceOperation::Type::kClose:
+      return "close";
+    default:
+      return "unknown";
+  }
+}
+
+size_t TypeIndex(TraceOperation::Type type) {
+  return static_cast<size_t>(std::find(std::begin(kTypes), std::end(kTypes), type) -
+                             std::begin(kTypes));
+}
+
+OperationLatencies Summarise(std::vector<std::chrono::nanoseconds>& durations) {
+  OperationLatencies latencies;
+  if (durations.empty())
+    return latencies;
+  std::sort(std::begin(durations), std::end(durations));
+  latencies.count = durations.size();
+  for (const auto& duration : durations)
+    latencies.total += duration;
+  latencies.p50 = durations[(durations.size() - 1) / 2];
+  latencies.p99 = durations[(durations.size() - 1) * 99 / 100];
+  latencies.max = durations.back();
+  return latencies;
+}
+
+std::chrono::nanoseconds CpuTime() {
+  return std::chrono::nanoseconds(static_cast<int64_t>(
+      static_cast<double>(std::clock()) * 1000000000.0 / CLOCKS_PER_SEC));
+}
+
+// Holds the expected contents of the file being replayed.
+class ShadowFile {
+ public:
+  explicit ShadowFile(bool enabled) : enabled_(enabled), contents_() {}
+
+  void Write(const char* data, uint32_t length, uint64_t position) {
+    if (!enabled_)
+      return;
+    if (position + length > contents_.size())
+      contents_.resize(static_cast<size_t>(position + length));
+    std::copy(data, data + length, &contents_[static_cast<size_t>(position)]);
+  }
+  void Truncate(uint64_t position) {
+    if (enabled_)
+      contents_.resize(static_cast<size_t>(position));
+  }
+  bool Matches(const char* data, uint32_t length, uint64_t position) const {
+    return !enabled_ ||
+           (position + length <= contents_.size() &&
+            std::equal(data, data + length, &contents_[static_cast<size_t>(position)]));
+  }
+
+ private:
+  const bool enabled_;
+  std::string contents_;
+};
+
+}  // unnamed namespace
+
+bool operator==(const TraceOperation& lhs, const TraceOperation& rhs) {
+  return lhs.type == rhs.type && lhs.position == rhs.position && lhs.length == rhs.length;
+}
+
+bool operator!=(const TraceOperation& lhs, const TraceOperation& rhs) { return !(lhs == rhs); }
+
+std::vector<TraceOperation> ReadTrace(std::istream& input) {
+  std::vector<TraceOperation> trace;
+  std::string line;
+  for (uint64_t line_number(1); std::getline(input, line); ++line_number) {
+    std::istringstream fields(line);
+    char type(0);
+    if (!(fields >> type) || type == '#')
+      continue;
+    TraceOperation operation(static_cast<TraceOperation::Type>(type));
+    bool valid(true);
+    switch (operation.type) {
+      case TraceOperation::Type::kWrite:
+      case TraceOperation::Type::kRead:
+        valid = static_cast<bool>(fields >> operation.position >> operation.length);
+        break;
+      case TraceOperation::Type::kTruncate:
+        valid = static_cast<bool>(fields >> operation.position);
+        break;
+      case TraceOperation::Type::kFlush:
+      case TraceOperation::Type::kClose:
+        break;
+      default:
+        valid = false;
+    }
+    std::string trailing;
+    if (!valid || fields >> trailing) {
+      LOG(kError) << "Malformed trace at line " << line_number << ": " << line;
+      BOOST_THROW_EXCEPTION(MakeError(CommonErrors::parsing_error));
+    }
+    trace.push_back(operation);
+  }
+  return trace;
+}
+
+void WriteTrace(std::ostream& output, const TraceOperation& operation) {
+  output << static_cast<char>(operation.type);
+  switch (operation.type) {
+    case TraceOperation::Type::kWrite:
+    case TraceOperation::Type::kRead:
+      output << ' ' << operation.position << ' ' << operation.length;
+      break;
+    case TraceOperation::Type::kTruncate:
+      output << ' ' << operation.position;
+      break;
+    default:
+      break;
+  }
+  output << '\n';
+}
+
+TracingSelfEncryptor::TracingSelfEncryptor(
+    DataMap& data_map, DataBuffer& buffer,
+    std::function<NonEmptyString(const std::string&)> get_from_store, std::ostream& trace)
+    : self_encryptor_(data_map, buffer, std::move(get_from_store)), trace_(trace) {}
+
+bool TracingSelfEncryptor::Write(const char* data, uint32_t length, uint64_t position) {
+  WriteTrace(trace_, TraceOperation(TraceOperation::Type::kWrite, position, length));
+  return self_encryptor_.Write(data, length, position);
+}
+
+bool TracingSelfEncryptor::Read(char* data, uint32_t length, uint64_t position) {
+  WriteTrace(trace_, TraceOperation(TraceOperation::Type::kRead, position, length));
+  return self_encryptor_.Read(data, length, position);
+}
+
+bool TracingSelfEncryptor::Truncate(uint64_t position) {
+  WriteTrace(trace_, TraceOperation(TraceOperation::Type::kTruncate, position));
+  return self_encryptor_.Truncate(position);
+}
+
+void TracingSelfEncryptor::Close() {
+  WriteTrace(trace_, TraceOperation(TraceOperation::Type::kClose));
+  self_encryptor_.Close();
+}
+
+bool TracingSelfEncryptor::Flush() {
+  WriteTrace(trace_, TraceOperation(TraceOperation::Type::kFlush));
+  return self_encryptor_.Flush();
+}
+
+const OperationLatencies& ReplayResult::operator[](TraceOperation::Type type) const {
+  return latencies[TypeIndex(type)];
+}
+
+std::string ReplayResult::ToString() const {
+  auto microseconds([](std::chrono::nanoseconds duration) { return duration.count() / 1000.0; });
+  std::ostringstream stream;
+  stream << std::left << std::setw(10) << "operation" << std::right << std::setw(10) << "count"
+         << std::setw(14) << "total ms" << std::setw(12) << "mean us" << std::setw(12) << "p50 us"
+         << std::setw(12) << "p99 us" << std::setw(12) << "max us" << '\n';
+  stream << std::fixed << std::setprecision(1);
+  for (auto type : kTypes) {
+    const OperationLatencies& operation((*this)[type]);
+    stream << std::left << std::setw(10) << TypeName(type) << std::right << std::setw(10)
+           << operation.count << std::setw(14) << microseconds(operation.total) / 1000.0
+           << std::setw(12)
+           << (operation.count == 0 ? 0.0 : microseconds(operation.total) / operation.count)
+           << std::setw(12) << microseconds(operation.p50) << std::setw(12)
+           << microseconds(operation.p99) << std::setw(12) << microseconds(operation.max) << '\n';
+  }
+  stream << "bytes written: " << bytes_written << ", bytes read: " << bytes_read
+         << ", failed reads: " << failed_reads << '\n'
+         << "wall time: " << microseconds(wall_time) / 1000.0
+         << " ms, CPU time: " << microseconds(cpu_time) / 1000.0 << " ms\n";
+  return stream.str();
+}
+
+ReplayResult ReplayTrace(const std::vector<TraceOperation>& trace, DataBuffer& buffer,
+                         std::function<NonEmptyString(const std::string&)> get_from_store,
+                         bool verify) {
+  // Writes take their data from a random offset into this, so that each write differs.
+  const uint32_t kOffsetRange(4096);
+  uint32_t max_length(0);
+  for (const auto& operation : trace)
+    max_length = std::max(max_length, operation.length);
+  const std::string kContent(RandomString(max_length + kOffsetRange));
+  std::unique_ptr<char[]> read_buffer(new char[std::max(max_length, 1U)]);
+
+  ReplayResult result;
+  std::array<std::vector<std::chrono::nanoseconds>, 5> durations;
+  ShadowFile shadow(verify);
+  DataMap data_map;
+  std::unique_ptr<SelfEncryptor> self_encryptor(
+      new SelfEncryptor(data_map, buffer, get_from_store));
+
+  const auto kStartCpuTime(CpuTime());
+  const auto kStartTime(std::chrono::steady_clock::now());
+  for (const auto& operation : trace) {
+    const char* const kData(&kContent[RandomUint32() % kOffsetRange]);
+    bool read(true);
+    auto start_time(std::chrono::steady_clock::now());
+    switch (operation.type) {
+      case TraceOperation::Type::kWrite:
+        self_encryptor->Write(kData, operation.length, operation.position);
+        break;
+      case TraceOperation::Type::kRead:
+        read = self_encryptor->Read(read_buffer.get(), operation.length, operation.position);
+        break;
+      case TraceOperation::Type::kTruncate:
+        self_encryptor->Truncate(operation.position);
+        break;
+      case TraceOperation::Type::kFlush:
+        self_encryptor->Flush();
+        break;
+      case TraceOperation::Type::kClose:
+        self_encryptor->Close();
+        self_encryptor.reset(new SelfEncryptor(data_map, buffer, get_from_store));
+        break;
+    }
+    durations[TypeIndex(operation.type)].push_back(std::chrono::steady_clock::now() - start_time);
+
+    if (operation.type == TraceOperation::Type::kWrite) {
+      shadow.Write(kData, operation.length, operation.position);
+      result.bytes_written += operation.length;
+    } else if (operation.type == TraceOperation::Type::kRead) {
+      if (!read || !shadow.Matches(read_buffer.get(), operation.length, operation.position))
+        ++result.failed_reads;
+      result.bytes_read += operation.length;
+    } else if (operation.type == TraceOperation::Type::kTruncate) {
+      shadow.Truncate(operation.position);
+    }
+  }
+  self_encryptor->Close();
+  result.wall_time = std::chrono::steady_clock::now() - kStartTime;
+  result.cpu_time = CpuTime() - kStartCpuTime;
+
+  for (size_t i(0); i != durations.size(); ++i)
+    result.latencies[i] = Summarise(durations[i]);
+  return result;
+}
+
+}  // namespace encrypt
+
+}  // namespace maidsafe
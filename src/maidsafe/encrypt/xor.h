@@ -41,6 +41,19 @@ namespace encrypt {
 const size_t kPadSize((3 * crypto::SHA512::DIGESTSIZE) - crypto::AES256_KeySize -
                       crypto::AES256_IVSize);
 
+// XORs 'data' in place with 'pad' repeated; equivalent to passing it through an XORFilter.
+inline void ApplyPad(byte* data, size_t length, const byte* pad, size_t pad_size = kPadSize) {
+  for (size_t i(0); i != length; ++i)
+    data[i] ^= pad[i % pad_size];
+}
+
+// As above, reading from 'input' and writing to 'output', so a copy and the XOR take one pass.
+inline void ApplyPad(const byte* input, byte* output, size_t length, const byte* pad,
+                     size_t pad_size = kPadSize) {
+  for (size_t i(0); i != length; ++i)
+    output[i] = input[i] ^ pad[i % pad_size];
+}
+
 class XORFilter : public CryptoPP::Bufferless<CryptoPP::Filter> {
  public:
   XORFilter(CryptoPP::BufferedTransformation* attachment, byte* pad, size_t pad_size = kPadSize)